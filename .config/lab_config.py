@@ -40,8 +40,8 @@ lab = {
             'target': f'{targets[0]}',
             'src': 'main.cc',
             'header': 'blink_scene.h',
-            'other_src': 'app/gl.cc app/glfwapp.cc app/glslshader.cc app/msutil.cc',
-            'other_header': 'app/glfwapp.h app/glslshader.h app/hid.h app/msutil.h app/scene.h ',
+            'other_src': 'app/commandbuffer.cc app/culling.cc app/drawbatcher.cc app/framepacer.cc app/frameprofiler.cc app/gl.cc app/gldebuglog.cc app/glfwapp.cc app/glslshader.cc app/glstate.cc app/hotreload.cc app/mesh.cc app/msutil.cc app/offscreen.cc app/programcache.cc app/programreflection.cc app/resourcecache.cc app/sceneloader.cc app/shaderlibrary.cc app/streambuffer.cc app/uniformblock.cc',
+            'other_header': 'app/commandbuffer.h app/culling.h app/drawbatcher.h app/framepacer.h app/frameprofiler.h app/gldebuglog.h app/glfwapp.h app/glslshader.h app/glstate.h app/hid.h app/hotreload.h app/mesh.h app/msutil.h app/offscreen.h app/programcache.h app/programreflection.h app/resourcecache.h app/scene.h app/sceneloader.h app/shaderlibrary.h app/streambuffer.h app/triplebuffer.h app/uniformblock.h ',
             'test_main': 'run_p1',
         },
     ],
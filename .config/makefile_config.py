@@ -25,13 +25,13 @@ global_makefile = {
     # Linux specific settings
     # pylint: disable-next=line-too-long
     'linux_CXXFLAGS': '-D LINUX',
-    'linux_LDFLAGS': '-lGL -lglfw',
+    'linux_LDFLAGS': '-lGL -lglfw -pthread',
     'linux_sed': 'sed',
     # pylint: disable-next=line-too-long
     'linux_GTESTINCLUDE': '-D LINUX',
     'linux_GTESTLIBS': '-L /usr/lib/gcc/x86_64-linux-gnu/11 -lgtest -lgtest_main -lpthread',
     'linux_GLAD': '/usr/bin/glad',
-    'linux_GLADFLAGS': '--api gl:core=3.3 --out-path glad c --debug --header-only',
+    'linux_GLADFLAGS': '--api gl:core=4.6 --out-path glad c --debug --header-only',
     # Darwin (macOS) specific settings assuming MacPorts, not Homebrew
     'darwin_CXXFLAGS': '-D OSX -I/opt/local/include',
     # pylint: disable-next=line-too-long
@@ -40,5 +40,5 @@ global_makefile = {
     'darwin_GTESTINCLUDE': '-I /opt/local/include -I /opt/local/src/googletest',
     'darwin_GTESTLIBS': '-L /opt/local/libexec/llvm-18/lib/libc++ -L /opt/local/libexec/llvm-18/lib -L /opt/local/libexec/llvm-18/lib/libunwind -L /opt/local/lib -lgtest -lgtest_main -lunwind -rpath /opt/local/libexec/llvm-18/lib/libc++ -rpath /opt/local/libexec/llvm-18/lib/libunwind',
     'darwin_GLAD': 'glad-3.13',
-    'darwin_GLADFLAGS': '--api gl:core=3.3 --out-path glad c --debug --header-only',
+    'darwin_GLADFLAGS': '--api gl:core=4.6 --out-path glad c --debug --header-only',
 }
@@ -0,0 +1,167 @@
+
+#include "commandbuffer.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+#include <type_traits>
+
+#include "glslshader.h"
+#include "glstate.h"
+
+namespace {
+
+template <typename T>
+T Read(const uint32_t* words, size_t& at) {
+  T payload;
+  std::memcpy(&payload, &words[at], sizeof(T));
+  at += sizeof(T) / sizeof(uint32_t);
+  return payload;
+}
+
+// Writes through the program's shadow when there is one, so that a later
+// write of the same value is not taken as redundant.
+template <typename T>
+void WriteUniform(GLSLProgram* program, GLint location, const T& value) {
+  if (program != nullptr) {
+    program->WriteUniform(location, value);
+  } else if constexpr (std::is_same_v<T, float>) {
+    glUniform1f(location, value);
+  } else if constexpr (std::is_same_v<T, glm::vec3>) {
+    glUniform3fv(location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::vec4>) {
+    glUniform4fv(location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::mat3>) {
+    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::mat4>) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported uniform type.");
+  }
+}
+
+}  // namespace
+
+void CommandBuffer::Execute() const {
+  GLStateCache& state{GLStateCache::Current()};
+  // The program uniform writes go through, if it was given as one.
+  GLSLProgram* program{nullptr};
+  const uint32_t* words{words_.data()};
+  size_t at{0};
+  while (at < words_.size()) {
+    const auto op{static_cast<CommandOp>(words[at++])};
+    switch (op) {
+      case CommandOp::kClearColor: {
+        const auto color{Read<glm::vec4>(words, at)};
+        glClearBufferfv(GL_COLOR, 0, glm::value_ptr(color));
+        break;
+      }
+      case CommandOp::kClearDepth: {
+        const auto depth{Read<float>(words, at)};
+        glClearBufferfv(GL_DEPTH, 0, &depth);
+        break;
+      }
+      case CommandOp::kUseProgram:
+        program = nullptr;
+        state.UseProgram(Read<GLuint>(words, at));
+        break;
+      case CommandOp::kUseGLSLProgram:
+        program = Read<GLSLProgram*>(words, at);
+        state.UseProgram(program->Id());
+        break;
+      case CommandOp::kBindVertexArray:
+        state.BindVertexArray(Read<GLuint>(words, at));
+        break;
+      case CommandOp::kViewport: {
+        const auto rect{Read<glm::ivec4>(words, at)};
+        state.Viewport(rect.x, rect.y, rect.z, rect.w);
+        break;
+      }
+      case CommandOp::kEnable:
+        state.Enable(Read<GLenum>(words, at));
+        break;
+      case CommandOp::kDisable:
+        state.Disable(Read<GLenum>(words, at));
+        break;
+      case CommandOp::kVertexAttrib4f: {
+        const auto attrib{Read<Indexed<glm::vec4>>(words, at)};
+        glVertexAttrib4fv(attrib.index, glm::value_ptr(attrib.value));
+        break;
+      }
+      case CommandOp::kUniform1f: {
+        const auto uniform{Read<Indexed<float>>(words, at)};
+        WriteUniform(program, uniform.index, uniform.value);
+        break;
+      }
+      case CommandOp::kUniform3f: {
+        const auto uniform{Read<Indexed<glm::vec3>>(words, at)};
+        WriteUniform(program, uniform.index, uniform.value);
+        break;
+      }
+      case CommandOp::kUniform4f: {
+        const auto uniform{Read<Indexed<glm::vec4>>(words, at)};
+        WriteUniform(program, uniform.index, uniform.value);
+        break;
+      }
+      case CommandOp::kUniformMatrix3f: {
+        const auto uniform{Read<Indexed<glm::mat3>>(words, at)};
+        WriteUniform(program, uniform.index, uniform.value);
+        break;
+      }
+      case CommandOp::kUniformMatrix4f: {
+        const auto uniform{Read<Indexed<glm::mat4>>(words, at)};
+        WriteUniform(program, uniform.index, uniform.value);
+        break;
+      }
+      case CommandOp::kDrawArrays: {
+        const auto draw{Read<glm::uvec3>(words, at)};
+        glDrawArrays(draw.x, static_cast<GLint>(draw.y),
+                     static_cast<GLsizei>(draw.z));
+        break;
+      }
+      case CommandOp::kDrawElements: {
+        const auto draw{Read<glm::uvec4>(words, at)};
+        glDrawElements(draw.x, static_cast<GLsizei>(draw.y), draw.z,
+                       // NOLINTNEXTLINE(performance-no-int-to-ptr)
+                       reinterpret_cast<const void*>(uintptr_t{draw.w}));
+        break;
+      }
+      case CommandOp::kDrawArraysInstanced: {
+        const auto draw{Read<glm::uvec4>(words, at)};
+        glDrawArraysInstanced(draw.x, static_cast<GLint>(draw.y),
+                              static_cast<GLsizei>(draw.z),
+                              static_cast<GLsizei>(draw.w));
+        break;
+      }
+      case CommandOp::kDrawElementsInstanced: {
+        const auto draw{Read<ElementsInstanced>(words, at)};
+        glDrawElementsInstanced(
+            draw.mode, static_cast<GLsizei>(draw.count), draw.type,
+            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+            reinterpret_cast<const void*>(uintptr_t{draw.offset}),
+            static_cast<GLsizei>(draw.instances));
+        break;
+      }
+    }
+  }
+}
+
+void CommandQueue::Submit(std::shared_ptr<const CommandBuffer> commands,
+                          uint32_t sort_key) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  pending_.push_back(Submission{sort_key, std::move(commands)});
+}
+
+void CommandQueue::Execute() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    executing_.swap(pending_);
+  }
+  std::stable_sort(executing_.begin(), executing_.end(),
+                   [](const Submission& a, const Submission& b) {
+                     return a.sort_key < b.sort_key;
+                   });
+  for (const Submission& submission : executing_) {
+    submission.commands->Execute();
+  }
+  executing_.clear();
+}
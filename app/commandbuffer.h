@@ -0,0 +1,182 @@
+#ifndef COMMANDBUFFER_H_
+#define COMMANDBUFFER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "glad/gl.h"
+
+class GLSLProgram;
+
+enum class CommandOp : uint32_t {
+  kClearColor,
+  kClearDepth,
+  kUseProgram,
+  kUseGLSLProgram,
+  kBindVertexArray,
+  kViewport,
+  kEnable,
+  kDisable,
+  kVertexAttrib4f,
+  kUniform1f,
+  kUniform3f,
+  kUniform4f,
+  kUniformMatrix3f,
+  kUniformMatrix4f,
+  kDrawArrays,
+  kDrawElements,
+  kDrawArraysInstanced,
+  kDrawElementsInstanced,
+};
+
+// A recorded list of GL commands. Recording only appends to a flat array of
+// 32-bit words and makes no GL calls, so any thread can record; Execute
+// replays the commands on the thread that owns the context, filtering binds
+// and state changes through the thread's GLStateCache. A buffer can be
+// executed any number of times, so static content is recorded once and
+// replayed every frame. Call Reset to record it again.
+class CommandBuffer {
+ public:
+  CommandBuffer() = default;
+
+  void Reset() { words_.clear(); }
+
+  bool IsEmpty() const { return words_.empty(); }
+
+  size_t SizeBytes() const { return words_.size() * sizeof(uint32_t); }
+
+  void ClearColor(const glm::vec4& color) {
+    Push(CommandOp::kClearColor, color);
+  }
+
+  void ClearDepth(float depth) { Push(CommandOp::kClearDepth, depth); }
+
+  void UseProgram(GLuint program) { Push(CommandOp::kUseProgram, program); }
+
+  // Uniform writes after this go through the program's WriteUniform, so
+  // they update its shadow of the values it holds. The program must
+  // outlive the recording; its Id() is read when the buffer is executed.
+  void UseProgram(GLSLProgram& program) {
+    Push(CommandOp::kUseGLSLProgram, &program);
+  }
+
+  void BindVertexArray(GLuint vao) {
+    Push(CommandOp::kBindVertexArray, vao);
+  }
+
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    Push(CommandOp::kViewport, glm::ivec4(x, y, width, height));
+  }
+
+  void Enable(GLenum capability) { Push(CommandOp::kEnable, capability); }
+
+  void Disable(GLenum capability) { Push(CommandOp::kDisable, capability); }
+
+  void VertexAttrib(GLuint index, const glm::vec4& value) {
+    Push(CommandOp::kVertexAttrib4f,
+         Indexed<glm::vec4>{static_cast<int32_t>(index), value});
+  }
+
+  // Uniform writes apply to the program bound by the last UseProgram. A
+  // program given by its id is written directly, so use it only for
+  // programs that no GLSLProgram shadows.
+  void Uniform(GLint location, float value) {
+    Push(CommandOp::kUniform1f, Indexed<float>{location, value});
+  }
+
+  void Uniform(GLint location, const glm::vec3& value) {
+    Push(CommandOp::kUniform3f, Indexed<glm::vec3>{location, value});
+  }
+
+  void Uniform(GLint location, const glm::vec4& value) {
+    Push(CommandOp::kUniform4f, Indexed<glm::vec4>{location, value});
+  }
+
+  void Uniform(GLint location, const glm::mat3& value) {
+    Push(CommandOp::kUniformMatrix3f, Indexed<glm::mat3>{location, value});
+  }
+
+  void Uniform(GLint location, const glm::mat4& value) {
+    Push(CommandOp::kUniformMatrix4f, Indexed<glm::mat4>{location, value});
+  }
+
+  void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    Push(CommandOp::kDrawArrays, glm::uvec3(mode, first, count));
+  }
+
+  void DrawElements(GLenum mode, GLsizei count, GLenum type, uint32_t offset) {
+    Push(CommandOp::kDrawElements, glm::uvec4(mode, count, type, offset));
+  }
+
+  void DrawArraysInstanced(GLenum mode, GLint first, GLsizei count,
+                           GLsizei instances) {
+    Push(CommandOp::kDrawArraysInstanced,
+         glm::uvec4(mode, first, count, instances));
+  }
+
+  void DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type,
+                             uint32_t offset, GLsizei instances) {
+    Push(CommandOp::kDrawElementsInstanced,
+         ElementsInstanced{mode, static_cast<uint32_t>(count), type, offset,
+                           static_cast<uint32_t>(instances)});
+  }
+
+  // Replays the commands on the current context.
+  void Execute() const;
+
+ private:
+  template <typename T>
+  struct Indexed {
+    int32_t index;
+    T value;
+  };
+
+  struct ElementsInstanced {
+    uint32_t mode;
+    uint32_t count;
+    uint32_t type;
+    uint32_t offset;
+    uint32_t instances;
+  };
+
+  template <typename T>
+  void Push(CommandOp op, const T& payload) {
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0,
+                  "Command payloads must be a whole number of words.");
+    const size_t at{words_.size()};
+    words_.resize(at + 1 + sizeof(T) / sizeof(uint32_t));
+    words_[at] = static_cast<uint32_t>(op);
+    std::memcpy(&words_[at + 1], &payload, sizeof(T));
+  }
+
+  std::vector<uint32_t> words_;
+};
+
+// Collects command buffers recorded on any thread and replays them on the
+// render thread ordered by a sort key; buffers with the same key replay in
+// submission order. Submitted buffers are shared, not copied, so a static
+// buffer can be submitted every frame at no cost.
+class CommandQueue {
+ public:
+  void Submit(std::shared_ptr<const CommandBuffer> commands,
+              uint32_t sort_key = 0);
+
+  // Replays and then forgets everything submitted so far.
+  void Execute();
+
+ private:
+  struct Submission {
+    uint32_t sort_key;
+    std::shared_ptr<const CommandBuffer> commands;
+  };
+
+  std::mutex mutex_;
+  std::vector<Submission> pending_;
+  std::vector<Submission> executing_;
+};
+
+#endif
@@ -0,0 +1,399 @@
+
+#include "culling.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "msutil.h"
+
+// glm only uses SSE and AVX with GLM_FORCE_INTRINSICS, which would change
+// the alignment of its vectors and matrices, and so every vertex and block
+// layout. The culler uses the intrinsics itself instead.
+#if defined(__AVX__)
+#define CULL_WITH_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#define CULL_WITH_SSE
+#endif
+
+#if defined(CULL_WITH_AVX) || defined(CULL_WITH_SSE)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The SoA arrays are padded to a multiple of the widest SIMD width, and
+// each thread's range starts at one.
+constexpr size_t kPadding{8};
+
+void Pad(size_t size, std::vector<float>& values) {
+  if (values.size() < size) {
+    values.resize(ms_util::RoundUp(size, kPadding), 0.0F);
+  }
+}
+
+#if defined(CULL_WITH_AVX)
+
+constexpr size_t kLanes{8};
+using Lanes = __m256;
+
+Lanes Broadcast(float value) { return _mm256_set1_ps(value); }
+Lanes Load(const float* values) { return _mm256_loadu_ps(values); }
+Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+Lanes Multiply(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+Lanes Negate(Lanes a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+Lanes GreaterEqual(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+Lanes AllTrue() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+unsigned int Mask(Lanes a) {
+  return static_cast<unsigned int>(_mm256_movemask_ps(a));
+}
+
+#elif defined(CULL_WITH_SSE)
+
+constexpr size_t kLanes{4};
+using Lanes = __m128;
+
+Lanes Broadcast(float value) { return _mm_set1_ps(value); }
+Lanes Load(const float* values) { return _mm_loadu_ps(values); }
+Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+Lanes Multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+Lanes Negate(Lanes a) { return _mm_sub_ps(_mm_setzero_ps(), a); }
+Lanes GreaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+Lanes AllTrue() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+unsigned int Mask(Lanes a) {
+  return static_cast<unsigned int>(_mm_movemask_ps(a));
+}
+
+#endif
+
+#if defined(CULL_WITH_AVX) || defined(CULL_WITH_SSE)
+
+// Appends begin + the index of each set bit of mask that is below end.
+void AppendVisible(unsigned int mask, size_t begin, size_t end,
+                   std::vector<uint32_t>& visible) {
+  if (end - begin < sizeof(mask) * 8) {
+    mask &= (1U << (end - begin)) - 1;
+  }
+  while (mask != 0) {
+    visible.push_back(static_cast<uint32_t>(begin + std::countr_zero(mask)));
+    mask &= mask - 1;
+  }
+}
+
+// A plane's coefficients, each in every lane, and the absolute values of
+// its normal for boxes.
+struct PlaneLanes {
+  Lanes x;
+  Lanes y;
+  Lanes z;
+  Lanes w;
+  Lanes abs_x;
+  Lanes abs_y;
+  Lanes abs_z;
+};
+
+std::array<PlaneLanes, 6> SplatPlanes(const Frustum& frustum) {
+  std::array<PlaneLanes, 6> planes{};
+  for (size_t p = 0; p < planes.size(); p++) {
+    const glm::vec4& plane{frustum.planes[p]};
+    planes[p] = PlaneLanes{
+        Broadcast(plane.x),           Broadcast(plane.y),
+        Broadcast(plane.z),           Broadcast(plane.w),
+        Broadcast(std::abs(plane.x)), Broadcast(std::abs(plane.y)),
+        Broadcast(std::abs(plane.z))};
+  }
+  return planes;
+}
+
+// The distance of each center from the plane.
+Lanes Distance(const PlaneLanes& plane, Lanes x, Lanes y, Lanes z) {
+  return Add(Add(Multiply(plane.x, x), Multiply(plane.y, y)),
+             Add(Multiply(plane.z, z), plane.w));
+}
+
+#endif
+
+void CullSpheres(const Frustum& frustum, const void* volumes, size_t begin,
+                 size_t end, std::vector<uint32_t>& visible) {
+  const auto& spheres{*static_cast<const BoundingSpheres*>(volumes)};
+#if defined(CULL_WITH_AVX) || defined(CULL_WITH_SSE)
+  const std::array<PlaneLanes, 6> planes{SplatPlanes(frustum)};
+  // Lanes past end read padding or the next range, and are masked off.
+  for (size_t i = begin; i < end; i += kLanes) {
+    const Lanes x{Load(spheres.X() + i)};
+    const Lanes y{Load(spheres.Y() + i)};
+    const Lanes z{Load(spheres.Z() + i)};
+    const Lanes negative_radius{Negate(Load(spheres.Radius() + i))};
+    Lanes inside{AllTrue()};
+    for (const PlaneLanes& plane : planes) {
+      inside = And(inside, GreaterEqual(Distance(plane, x, y, z),
+                                        negative_radius));
+    }
+    AppendVisible(Mask(inside), i, end, visible);
+  }
+#else
+  for (size_t i = begin; i < end; i++) {
+    if (frustum.IntersectsSphere(
+            glm::vec3{spheres.X()[i], spheres.Y()[i], spheres.Z()[i]},
+            spheres.Radius()[i])) {
+      visible.push_back(static_cast<uint32_t>(i));
+    }
+  }
+#endif
+}
+
+void CullBoxes(const Frustum& frustum, const void* volumes, size_t begin,
+               size_t end, std::vector<uint32_t>& visible) {
+  const auto& boxes{*static_cast<const BoundingBoxes*>(volumes)};
+#if defined(CULL_WITH_AVX) || defined(CULL_WITH_SSE)
+  const std::array<PlaneLanes, 6> planes{SplatPlanes(frustum)};
+  for (size_t i = begin; i < end; i += kLanes) {
+    const Lanes x{Load(boxes.CenterX() + i)};
+    const Lanes y{Load(boxes.CenterY() + i)};
+    const Lanes z{Load(boxes.CenterZ() + i)};
+    const Lanes extent_x{Load(boxes.ExtentX() + i)};
+    const Lanes extent_y{Load(boxes.ExtentY() + i)};
+    const Lanes extent_z{Load(boxes.ExtentZ() + i)};
+    Lanes inside{AllTrue()};
+    for (const PlaneLanes& plane : planes) {
+      // How far the box reaches toward the plane from its center.
+      const Lanes reach{Add(Add(Multiply(plane.abs_x, extent_x),
+                                Multiply(plane.abs_y, extent_y)),
+                            Multiply(plane.abs_z, extent_z))};
+      inside = And(inside, GreaterEqual(Distance(plane, x, y, z),
+                                        Negate(reach)));
+    }
+    AppendVisible(Mask(inside), i, end, visible);
+  }
+#else
+  for (size_t i = begin; i < end; i++) {
+    const glm::vec3 center{boxes.CenterX()[i], boxes.CenterY()[i],
+                           boxes.CenterZ()[i]};
+    const glm::vec3 extent{boxes.ExtentX()[i], boxes.ExtentY()[i],
+                           boxes.ExtentZ()[i]};
+    if (frustum.IntersectsBox(center - extent, center + extent)) {
+      visible.push_back(static_cast<uint32_t>(i));
+    }
+  }
+#endif
+}
+
+// The range of volumes the thread culls: an equal share, starting at a
+// multiple of kPadding.
+void RangeBounds(size_t size, unsigned int num_ranges, unsigned int range,
+                 size_t& begin, size_t& end) {
+  const size_t per_range{ms_util::RoundUp(
+      (size + num_ranges - 1) / num_ranges, kPadding)};
+  begin = std::min(size, range * per_range);
+  end = std::min(size, begin + per_range);
+}
+
+}  // namespace
+
+Frustum Frustum::FromMatrix(const glm::mat4& view_projection) {
+  // The rows of the matrix are the columns of its transpose.
+  const glm::mat4 rows{glm::transpose(view_projection)};
+  Frustum frustum{};
+  frustum.planes[kLeft] = rows[3] + rows[0];
+  frustum.planes[kRight] = rows[3] - rows[0];
+  frustum.planes[kBottom] = rows[3] + rows[1];
+  frustum.planes[kTop] = rows[3] - rows[1];
+  frustum.planes[kNear] = rows[3] + rows[2];
+  frustum.planes[kFar] = rows[3] - rows[2];
+  for (glm::vec4& plane : frustum.planes) {
+    plane /= glm::length(glm::vec3{plane});
+  }
+  return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+  return std::all_of(planes.begin(), planes.end(), [&](const glm::vec4& p) {
+    return glm::dot(glm::vec3{p}, center) + p.w >= -radius;
+  });
+}
+
+bool Frustum::IntersectsBox(const glm::vec3& min,
+                            const glm::vec3& max) const {
+  const glm::vec3 center{(min + max) * 0.5F};
+  const glm::vec3 extent{(max - min) * 0.5F};
+  return std::all_of(planes.begin(), planes.end(), [&](const glm::vec4& p) {
+    const glm::vec3 normal{p};
+    return glm::dot(normal, center) + p.w >= -glm::dot(glm::abs(normal),
+                                                       extent);
+  });
+}
+
+uint32_t BoundingSpheres::Add(const glm::vec3& center, float radius) {
+  const auto index{static_cast<uint32_t>(size_)};
+  size_++;
+  Pad(size_, x_);
+  Pad(size_, y_);
+  Pad(size_, z_);
+  Pad(size_, radius_);
+  Set(index, center, radius);
+  return index;
+}
+
+void BoundingSpheres::Set(uint32_t index, const glm::vec3& center,
+                          float radius) {
+  x_[index] = center.x;
+  y_[index] = center.y;
+  z_[index] = center.z;
+  radius_[index] = radius;
+}
+
+void BoundingSpheres::Clear() {
+  size_ = 0;
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  radius_.clear();
+}
+
+uint32_t BoundingBoxes::Add(const glm::vec3& min, const glm::vec3& max) {
+  const auto index{static_cast<uint32_t>(size_)};
+  size_++;
+  for (std::vector<float>* values :
+       {&center_x_, &center_y_, &center_z_, &extent_x_, &extent_y_,
+        &extent_z_}) {
+    Pad(size_, *values);
+  }
+  Set(index, min, max);
+  return index;
+}
+
+void BoundingBoxes::Set(uint32_t index, const glm::vec3& min,
+                        const glm::vec3& max) {
+  const glm::vec3 center{(min + max) * 0.5F};
+  const glm::vec3 extent{(max - min) * 0.5F};
+  center_x_[index] = center.x;
+  center_y_[index] = center.y;
+  center_z_[index] = center.z;
+  extent_x_[index] = extent.x;
+  extent_y_[index] = extent.y;
+  extent_z_[index] = extent.z;
+}
+
+void BoundingBoxes::Clear() {
+  size_ = 0;
+  for (std::vector<float>* values :
+       {&center_x_, &center_y_, &center_z_, &extent_x_, &extent_y_,
+        &extent_z_}) {
+    values->clear();
+  }
+}
+
+FrustumCuller::FrustumCuller(unsigned int num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  ranges_.resize(num_threads);
+  for (unsigned int worker = 0; worker + 1 < num_threads; worker++) {
+    workers_.emplace_back(&FrustumCuller::WorkerLoop, this, worker);
+  }
+}
+
+FrustumCuller::~FrustumCuller() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void FrustumCuller::Cull(const Frustum& frustum,
+                         const BoundingSpheres& spheres,
+                         std::vector<uint32_t>& visible) {
+  Run(CullSpheres, frustum, &spheres, spheres.Size(), visible);
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, const BoundingBoxes& boxes,
+                         std::vector<uint32_t>& visible) {
+  Run(CullBoxes, frustum, &boxes, boxes.Size(), visible);
+}
+
+void FrustumCuller::Run(Kernel kernel, const Frustum& frustum,
+                        const void* volumes, size_t size,
+                        std::vector<uint32_t>& visible) {
+  const auto num_ranges{static_cast<unsigned int>(std::min<size_t>(
+      NumThreads(), std::max<size_t>(size / kMinVolumesPerThread, 1)))};
+  stats_.calls++;
+  stats_.tested += size;
+  visible.clear();
+  if (num_ranges == 1) {
+    kernel(frustum, volumes, 0, size, visible);
+    stats_.visible += visible.size();
+    return;
+  }
+  stats_.parallel_calls++;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    kernel_ = kernel;
+    frustum_ = &frustum;
+    volumes_ = volumes;
+    size_ = size;
+    num_ranges_ = num_ranges;
+    pending_ = num_ranges - 1;
+    generation_++;
+  }
+  start_.notify_all();
+  size_t begin{0};
+  size_t end{0};
+  RangeBounds(size, num_ranges, 0, begin, end);
+  kernel(frustum, volumes, begin, end, visible);
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+  // The ranges are in order, so the indices stay ascending.
+  for (unsigned int range = 1; range < num_ranges; range++) {
+    visible.insert(visible.end(), ranges_[range].begin(),
+                   ranges_[range].end());
+  }
+  stats_.visible += visible.size();
+}
+
+void FrustumCuller::WorkerLoop(unsigned int worker) {
+  // Worker i culls range i + 1; the caller culls range 0.
+  const unsigned int range{worker + 1};
+  unsigned long seen{0};
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    start_.wait(lock, [&] { return stop_ or generation_ != seen; });
+    if (stop_) {
+      return;
+    }
+    seen = generation_;
+    if (range >= num_ranges_) {
+      continue;
+    }
+    const Kernel kernel{kernel_};
+    const Frustum& frustum{*frustum_};
+    const void* volumes{volumes_};
+    size_t begin{0};
+    size_t end{0};
+    RangeBounds(size_, num_ranges_, range, begin, end);
+    lock.unlock();
+    ranges_[range].clear();
+    kernel(frustum, volumes, begin, end, ranges_[range]);
+    lock.lock();
+    pending_--;
+    if (pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const CullStats& stats) {
+  out << stats.calls << " culls (" << stats.parallel_calls
+      << " multi-threaded), " << stats.visible << " of " << stats.tested
+      << " volumes visible";
+  return out;
+}
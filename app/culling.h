@@ -0,0 +1,164 @@
+#ifndef CULLING_H_
+#define CULLING_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The six planes of a view frustum, each a normalized (normal, distance)
+// with the normal pointing in, so a point p is inside a plane when
+// dot(normal, p) + distance >= 0.
+struct Frustum {
+  enum Plane { kLeft, kRight, kBottom, kTop, kNear, kFar };
+
+  // Extracts the world space planes from projection * view, or the object
+  // space planes from projection * view * model. Expects OpenGL's clip
+  // space, where -w <= z <= w.
+  static Frustum FromMatrix(const glm::mat4& view_projection);
+
+  // Conservative: a volume outside the frustum but near a corner of it may
+  // be reported as intersecting.
+  bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+  bool IntersectsBox(const glm::vec3& min, const glm::vec3& max) const;
+
+  std::array<glm::vec4, 6> planes;
+};
+
+// Bounding spheres stored as structure of arrays, so that a culling loop
+// loads four or eight of each coordinate at once. The arrays are padded
+// to a whole number of eight so the loops need no scalar tail.
+class BoundingSpheres {
+ public:
+  // Returns the sphere's index.
+  uint32_t Add(const glm::vec3& center, float radius);
+
+  void Set(uint32_t index, const glm::vec3& center, float radius);
+
+  void Clear();
+
+  size_t Size() const { return size_; }
+
+  const float* X() const { return x_.data(); }
+  const float* Y() const { return y_.data(); }
+  const float* Z() const { return z_.data(); }
+  const float* Radius() const { return radius_.data(); }
+
+ private:
+  size_t size_{0};
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<float> radius_;
+};
+
+// Axis-aligned bounding boxes stored as structure of arrays of centers and
+// half extents, padded like BoundingSpheres.
+class BoundingBoxes {
+ public:
+  // Returns the box's index.
+  uint32_t Add(const glm::vec3& min, const glm::vec3& max);
+
+  void Set(uint32_t index, const glm::vec3& min, const glm::vec3& max);
+
+  void Clear();
+
+  size_t Size() const { return size_; }
+
+  const float* CenterX() const { return center_x_.data(); }
+  const float* CenterY() const { return center_y_.data(); }
+  const float* CenterZ() const { return center_z_.data(); }
+  const float* ExtentX() const { return extent_x_.data(); }
+  const float* ExtentY() const { return extent_y_.data(); }
+  const float* ExtentZ() const { return extent_z_.data(); }
+
+ private:
+  size_t size_{0};
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> center_z_;
+  std::vector<float> extent_x_;
+  std::vector<float> extent_y_;
+  std::vector<float> extent_z_;
+};
+
+struct CullStats {
+  unsigned long calls{0};
+  unsigned long tested{0};
+  unsigned long visible{0};
+  // Calls that were split across threads.
+  unsigned long parallel_calls{0};
+};
+
+// Tests bounding volumes against a frustum four at a time with SSE or
+// eight at a time with AVX, whichever the compiler targets (build with
+// -mavx or -march=native for AVX), and one at a time elsewhere. Large
+// sets are split into one contiguous range per thread. The result is the
+// ascending indices of the volumes that intersect the frustum, ready to
+// draw, for example by adding each to a DrawBatcher.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class FrustumCuller {
+ public:
+  // Sets smaller than this are culled on the calling thread.
+  static constexpr size_t kMinVolumesPerThread{4096};
+
+  // Uses num_threads threads including the caller; 0 means one per
+  // hardware thread.
+  explicit FrustumCuller(unsigned int num_threads = 0);
+
+  ~FrustumCuller();
+
+  FrustumCuller(const FrustumCuller&) = delete;
+  FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+  // Replaces visible with the indices of the spheres in the frustum.
+  void Cull(const Frustum& frustum, const BoundingSpheres& spheres,
+            std::vector<uint32_t>& visible);
+
+  void Cull(const Frustum& frustum, const BoundingBoxes& boxes,
+            std::vector<uint32_t>& visible);
+
+  unsigned int NumThreads() const {
+    return static_cast<unsigned int>(workers_.size()) + 1;
+  }
+
+  const CullStats& Stats() const { return stats_; }
+
+ private:
+  // Culls volumes [begin, end) and appends the visible ones to visible.
+  using Kernel = void (*)(const Frustum& frustum, const void* volumes,
+                          size_t begin, size_t end,
+                          std::vector<uint32_t>& visible);
+
+  void Run(Kernel kernel, const Frustum& frustum, const void* volumes,
+           size_t size, std::vector<uint32_t>& visible);
+
+  void WorkerLoop(unsigned int worker);
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  // The job the workers run when generation_ changes.
+  Kernel kernel_{nullptr};
+  const Frustum* frustum_{nullptr};
+  const void* volumes_{nullptr};
+  size_t size_{0};
+  unsigned int num_ranges_{0};
+  unsigned long generation_{0};
+  unsigned int pending_{0};
+  bool stop_{false};
+  // The visible indices of each thread's range; the caller's is first.
+  std::vector<std::vector<uint32_t>> ranges_;
+  std::vector<std::thread> workers_;
+  CullStats stats_;
+};
+
+std::ostream& operator<<(std::ostream& out, const CullStats& stats);
+
+#endif
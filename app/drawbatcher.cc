@@ -0,0 +1,126 @@
+
+#include "drawbatcher.h"
+
+#include <algorithm>
+
+#include "glstate.h"
+
+namespace {
+
+// Throws unless the context is supported, so that no buffer is made.
+size_t StorageBufferAlignment() {
+  if (not DrawBatcher::IsSupported()) {
+    throw DrawBatchException(
+        "Batching draws needs OpenGL 4.3 and "
+        "ARB_shader_draw_parameters.");
+  }
+  GLint alignment{0};
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  return static_cast<size_t>(std::max(alignment, 1));
+}
+
+}  // namespace
+
+bool DrawBatcher::IsSupported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return GLAD_GL_VERSION_4_3 != 0 and
+         GLAD_GL_ARB_shader_draw_parameters != 0;
+#endif
+}
+
+DrawBatcher::DrawBatcher(size_t per_draw_size, size_t max_draws_per_frame,
+                         size_t max_submits_per_frame,
+                         GLuint storage_binding)
+    : per_draw_size_{per_draw_size},
+      storage_binding_{storage_binding},
+      // Each Submit's data starts at an aligned offset.
+      storage_{GL_SHADER_STORAGE_BUFFER,
+               max_draws_per_frame * per_draw_size +
+                   max_submits_per_frame * StorageBufferAlignment(),
+               StorageBufferAlignment()},
+      commands_{GL_DRAW_INDIRECT_BUFFER,
+                max_draws_per_frame * sizeof(DrawElementsIndirectCommand),
+                sizeof(GLuint)} {}
+
+void DrawBatcher::BeginFrame() {
+  storage_.BeginFrame();
+  commands_.BeginFrame();
+}
+
+std::span<std::byte> DrawBatcher::Add(
+    const DrawBatchKey& key, const DrawElementsIndirectCommand& command) {
+  // The first draw's data is aligned for binding; the rest are packed
+  // after it, so that a draw's index finds its data.
+  const StreamRange data{
+      storage_.Allocate(per_draw_size_, queued_.empty() ? 0 : 1)};
+  if (queued_.empty()) {
+    data_offset_ = data.offset;
+  }
+  queued_.push_back(QueuedDraw{key, command});
+  queued_.back().command.base_instance =
+      static_cast<GLuint>(queued_.size() - 1);
+  return std::span<std::byte>{data.data, per_draw_size_};
+}
+
+void DrawBatcher::Submit() {
+  if (queued_.empty()) {
+    return;
+  }
+  // The base instances are the order the draws were added in.
+  std::sort(queued_.begin(), queued_.end(),
+            [](const QueuedDraw& a, const QueuedDraw& b) {
+              return a.key < b.key or
+                     (a.key == b.key and
+                      a.command.base_instance < b.command.base_instance);
+            });
+
+  StreamRange range;
+  const std::span<DrawElementsIndirectCommand> commands{
+      commands_.Allocate<DrawElementsIndirectCommand>(queued_.size(),
+                                                      range)};
+  batches_.clear();
+  for (size_t i = 0; i < queued_.size(); i++) {
+    commands[i] = queued_[i].command;
+    if (batches_.empty() or batches_.back().key != queued_[i].key) {
+      batches_.push_back(Batch{
+          queued_[i].key, 0,
+          range.offset + static_cast<GLintptr>(
+                             i * sizeof(DrawElementsIndirectCommand))});
+    }
+    batches_.back().count++;
+  }
+  storage_.Flush();
+  commands_.Flush();
+
+  GLStateCache& state{GLStateCache::Current()};
+  state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, commands_.Id());
+  if (per_draw_size_ > 0) {
+    state.BindBufferRange(
+        GL_SHADER_STORAGE_BUFFER, storage_binding_, storage_.Id(),
+        data_offset_,
+        static_cast<GLsizeiptr>(queued_.size() * per_draw_size_));
+  }
+  for (const Batch& batch : batches_) {
+    state.UseProgram(batch.key.program);
+    state.BindVertexArray(batch.key.vao);
+    glMultiDrawElementsIndirect(
+        batch.key.mode, batch.key.index_type,
+        // NOLINTNEXTLINE(performance-no-int-to-ptr)
+        reinterpret_cast<const void*>(batch.offset), batch.count, 0);
+  }
+  stats_.draws += queued_.size();
+  stats_.batches += batches_.size();
+  queued_.clear();
+}
+
+void DrawBatcher::EndFrame() {
+  storage_.EndFrame();
+  commands_.EndFrame();
+}
+
+std::ostream& operator<<(std::ostream& out, const DrawBatchStats& stats) {
+  out << stats.draws << " draws in " << stats.batches << " batches";
+  return out;
+}
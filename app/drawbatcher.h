@@ -0,0 +1,167 @@
+#ifndef DRAWBATCHER_H_
+#define DRAWBATCHER_H_
+
+#include <compare>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "glad/gl.h"
+#include "mesh.h"
+#include "streambuffer.h"
+#include "uniformblock.h"
+
+class DrawBatchException : public std::runtime_error {
+ public:
+  explicit DrawBatchException(const std::string& message)
+      : std::runtime_error(message) {}
+};
+
+// What glMultiDrawElementsIndirect reads for each draw.
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 5 * sizeof(GLuint));
+
+// The state that draws must share to go out in one call.
+struct DrawBatchKey {
+  GLuint program;
+  GLuint vao;
+  GLenum mode;
+  // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  GLenum index_type;
+
+  auto operator<=>(const DrawBatchKey&) const = default;
+};
+
+struct DrawBatchStats {
+  unsigned long draws{0};
+  // glMultiDrawElementsIndirect calls.
+  unsigned long batches{0};
+};
+
+// Collects indexed draws and submits the draws that share a DrawBatchKey
+// with one glMultiDrawElementsIndirect, so thousands of objects go out in
+// as many calls as there are programs and vertex arrays. Each draw has
+// per_draw_size bytes of data, such as a transform and a color, which Add
+// has the caller write straight into a streamed std430 shader storage
+// block at storage_binding. The data stays in the order the draws were
+// added; only the commands are sorted. Each command's base instance is its
+// draw's index into the block, so the vertex shader finds its data with
+// gl_BaseInstanceARB:
+//
+//   #extension GL_ARB_shader_draw_parameters : require
+//   struct Draw {
+//     mat4 model;
+//     vec4 color;
+//   };
+//   layout (std430, binding = 0) readonly buffer Draws { Draw draws[]; };
+//   ...
+//   gl_Position = draws[gl_BaseInstanceARB].model * vec4(position, 1.0);
+//
+// Batched meshes must therefore not have per-instance attributes. The
+// commands and the data are streamed through StreamBuffers, so call
+// BeginFrame and EndFrame around the frame's draws.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class DrawBatcher {
+ public:
+  // Multi-draw indirect and shader storage blocks need OpenGL 4.3, and
+  // gl_BaseInstanceARB needs ARB_shader_draw_parameters, even on OpenGL
+  // 4.6, whose core gl_BaseInstance the shaders do not use.
+  static bool IsSupported();
+
+  static constexpr size_t kDefaultMaxSubmitsPerFrame{16};
+
+  // Needs a current context. Throws a DrawBatchException when the context
+  // is not supported.
+  DrawBatcher(size_t per_draw_size, size_t max_draws_per_frame,
+              size_t max_submits_per_frame = kDefaultMaxSubmitsPerFrame,
+              GLuint storage_binding = 0);
+
+  DrawBatcher(const DrawBatcher&) = delete;
+  DrawBatcher& operator=(const DrawBatcher&) = delete;
+
+  void BeginFrame();
+
+  // Queues a draw and returns where to write its per_draw_size bytes, in
+  // the stream buffer itself. The command's base_instance is replaced by
+  // the draw's index. Throws a StreamBufferException when the frame has
+  // more than max_draws_per_frame draws.
+  std::span<std::byte> Add(const DrawBatchKey& key,
+                           const DrawElementsIndirectCommand& command);
+
+  // Queues a draw of every index of mesh, whose vertex array must exist,
+  // with data packed by Layout, a std430 BlockLayout of per_draw_size
+  // bytes.
+  template <typename Layout, typename MeshLayout, typename... Values>
+  void Add(GLuint program, const Mesh<MeshLayout>& mesh,
+           const Values&... values) {
+    static_assert(Layout::kPacking == BlockPacking::kStd430,
+                  "Shader storage blocks are std430.");
+    if (Layout::kSize != per_draw_size_) {
+      throw DrawBatchException("The per-draw layout is " +
+                               std::to_string(Layout::kSize) +
+                               " bytes, not " +
+                               std::to_string(per_draw_size_) + ".");
+    }
+    if (mesh.VertexArray() == 0 or mesh.Indices().Count() == 0) {
+      throw DrawBatchException(
+          "Only bound meshes with indices can be batched.");
+    }
+    const std::span<std::byte> data{Add(
+        DrawBatchKey{program, mesh.VertexArray(), mesh.Mode(),
+                     mesh.Indices().Type()},
+        DrawElementsIndirectCommand{
+            static_cast<GLuint>(mesh.Indices().Count()), 1, 0, 0, 0})};
+    Layout::Pack(data.data(), values...);
+  }
+
+  // Sorts the queued commands into batches and draws each batch with one
+  // call. Draws with the same key keep the order they were added in.
+  // Throws a StreamBufferException when the frame has more than
+  // max_submits_per_frame Submits.
+  void Submit();
+
+  // Call after the frame's last Submit.
+  void EndFrame();
+
+  const DrawBatchStats& Stats() const { return stats_; }
+
+ private:
+  struct QueuedDraw {
+    DrawBatchKey key;
+    DrawElementsIndirectCommand command;
+  };
+
+  struct Batch {
+    DrawBatchKey key;
+    GLsizei count;
+    // Into commands_.
+    GLintptr offset;
+  };
+
+  size_t per_draw_size_;
+  GLuint storage_binding_;
+  // Made first, because it checks that the context is supported.
+  StreamBuffer storage_;
+  StreamBuffer commands_;
+  // Where the data of the first queued draw starts in storage_; the rest
+  // follow it with no gaps.
+  GLintptr data_offset_{0};
+  // Kept between frames to save allocations.
+  std::vector<QueuedDraw> queued_;
+  std::vector<Batch> batches_;
+  DrawBatchStats stats_;
+};
+
+std::ostream& operator<<(std::ostream& out, const DrawBatchStats& stats);
+
+#endif
@@ -0,0 +1,112 @@
+
+#include "framepacer.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+namespace {
+// Sleeping is only accurate to about a millisecond on most systems, so the
+// last part of the wait is spent yielding in a loop.
+constexpr std::chrono::microseconds kSpinMargin{1000};
+}  // namespace
+
+std::string PacingPolicyToString(PacingPolicy policy) {
+  std::string name{"unknown"};
+  switch (policy) {
+    case PacingPolicy::kVSync:
+      name = "vsync";
+      break;
+    case PacingPolicy::kSleep:
+      name = "sleep";
+      break;
+    case PacingPolicy::kWaitEvents:
+      name = "wait";
+      break;
+  }
+  return name;
+}
+
+bool StringToPacingPolicy(const std::string& name, PacingPolicy& policy) {
+  for (const PacingPolicy candidate :
+       {PacingPolicy::kVSync, PacingPolicy::kSleep, PacingPolicy::kWaitEvents}) {
+    if (name == PacingPolicyToString(candidate)) {
+      policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::ostream& operator<<(std::ostream& out, const PacingStats& stats) {
+  out << std::fixed << std::setprecision(3) << "Pacing: " << stats.frames
+      << " frames, error (ms): mean " << stats.mean_error_ms << " max "
+      << stats.max_error_ms << ", " << stats.late_frames << " late frames\n"
+      << std::defaultfloat;
+  return out;
+}
+
+FramePacer::FramePacer(unsigned int fps, PacingPolicy policy)
+    : period_{std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / fps))},
+      policy_{policy} {}
+
+void FramePacer::Start() {
+  if (glfwGetCurrentContext() != nullptr) {
+    glfwSwapInterval(policy_ == PacingPolicy::kVSync ? 1 : 0);
+  }
+  deadline_ = Clock::now();
+  has_last_start_ = false;
+  total_error_ms_ = 0.0;
+  stats_ = PacingStats{};
+}
+
+void FramePacer::WaitForNextFrame() {
+  Clock::time_point now{Clock::now()};
+  switch (policy_) {
+    case PacingPolicy::kVSync:
+      // glfwSwapBuffers already waited for the display.
+      break;
+    case PacingPolicy::kSleep:
+      if (deadline_ - now > kSpinMargin) {
+        std::this_thread::sleep_until(deadline_ - kSpinMargin);
+      }
+      while ((now = Clock::now()) < deadline_) {
+        std::this_thread::yield();
+      }
+      break;
+    case PacingPolicy::kWaitEvents:
+      while ((now = Clock::now()) < deadline_) {
+        glfwWaitEventsTimeout(
+            std::chrono::duration<double>(deadline_ - now).count());
+      }
+      break;
+  }
+  deadline_ += period_;
+  if (deadline_ < now) {
+    deadline_ = now + period_;
+  }
+  FrameStarted(now);
+}
+
+void FramePacer::FrameStarted(Clock::time_point now) {
+  if (has_last_start_) {
+    const double interval_ms{
+        std::chrono::duration<double, std::milli>(now - last_start_).count()};
+    const double period_ms{
+        std::chrono::duration<double, std::milli>(period_).count()};
+    const double error_ms{std::abs(interval_ms - period_ms)};
+    stats_.frames++;
+    total_error_ms_ += error_ms;
+    stats_.mean_error_ms = total_error_ms_ / stats_.frames;
+    stats_.max_error_ms = std::max(stats_.max_error_ms, error_ms);
+    if (interval_ms - period_ms > 0.5 * period_ms) {
+      stats_.late_frames++;
+    }
+  }
+  last_start_ = now;
+  has_last_start_ = true;
+}
@@ -0,0 +1,67 @@
+#ifndef FRAMEPACER_H_
+#define FRAMEPACER_H_
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// How GLFWApp waits between frames.
+//  kVSync: let glfwSwapBuffers block on the display's refresh.
+//  kSleep: sleep until the next frame's deadline, then spin for the last
+//          fraction of a millisecond to hit it precisely.
+//  kWaitEvents: block in glfwWaitEventsTimeout until the deadline so input
+//               is handled as it arrives and an idle app uses no CPU.
+enum class PacingPolicy { kVSync, kSleep, kWaitEvents };
+
+std::string PacingPolicyToString(PacingPolicy policy);
+
+bool StringToPacingPolicy(const std::string& name, PacingPolicy& policy);
+
+// Pacing error is how far the time between two consecutive frame starts was
+// from the target frame period.
+struct PacingStats {
+  unsigned long frames{0};
+  double mean_error_ms{0.0};
+  double max_error_ms{0.0};
+  // Frames that started more than half a period late.
+  unsigned long late_frames{0};
+};
+
+std::ostream& operator<<(std::ostream& out, const PacingStats& stats);
+
+class FramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  FramePacer(unsigned int fps, PacingPolicy policy);
+
+  PacingPolicy Policy() const { return policy_; }
+
+  void SetPolicy(PacingPolicy policy) { policy_ = policy; }
+
+  // Sets the swap interval for the current context, if there is one, and
+  // resets the deadline and the statistics. Call once before entering the
+  // loop. kWaitEvents must only be used on the main thread.
+  void Start();
+
+  // Returns when the next frame is due. Deadlines advance by exactly one
+  // period so leftover time carries into the next frame; if the loop falls
+  // more than a period behind the deadline is moved to now instead of
+  // trying to catch up.
+  void WaitForNextFrame();
+
+  const PacingStats& Stats() const { return stats_; }
+
+ private:
+  void FrameStarted(Clock::time_point now);
+
+  Clock::duration period_;
+  PacingPolicy policy_;
+  Clock::time_point deadline_;
+  Clock::time_point last_start_;
+  bool has_last_start_{false};
+  double total_error_ms_{0.0};
+  PacingStats stats_;
+};
+
+#endif
@@ -0,0 +1,192 @@
+
+#include "frameprofiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
+#include "msutil.h"
+
+const char* FramePhaseToString(FramePhase phase) {
+  switch (phase) {
+    case FramePhase::kUpdate:
+      return "update";
+    case FramePhase::kDraw:
+      return "draw";
+    case FramePhase::kSwap:
+      return "swap";
+    case FramePhase::kPollEvents:
+      return "poll_events";
+    case FramePhase::kGpu:
+      return "gpu";
+    default:
+      return "?";
+  }
+}
+
+void RollingSamples::Add(double ms) {
+  if (samples_.size() < kWindow) {
+    samples_.push_back(ms);
+  } else {
+    samples_[next_] = ms;
+  }
+  next_ = (next_ + 1) % kWindow;
+}
+
+PhaseSummary RollingSamples::Summarize() const {
+  PhaseSummary summary;
+  if (samples_.empty()) {
+    return summary;
+  }
+  std::vector<double> sorted{samples_};
+  std::sort(sorted.begin(), sorted.end());
+  // Nearest-rank percentile.
+  auto percentile = [&sorted](double p) {
+    const auto rank{static_cast<size_t>(std::ceil(p * sorted.size()))};
+    return sorted[std::max<size_t>(rank, 1) - 1];
+  };
+  summary.count = sorted.size();
+  summary.mean_ms =
+      std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+  summary.p50_ms = percentile(0.50);
+  summary.p95_ms = percentile(0.95);
+  summary.p99_ms = percentile(0.99);
+  summary.max_ms = sorted.back();
+  return summary;
+}
+
+GpuTimer::GpuTimer() {
+  glGenQueries(kLatency, queries_.data());
+  ms_util::GLErrorCheck();
+}
+
+GpuTimer::~GpuTimer() { glDeleteQueries(kLatency, queries_.data()); }
+
+void GpuTimer::Begin() {
+  current_ = (current_ + 1) % kLatency;
+  if (pending_[current_]) {
+    double ms{0.0};
+    if (not TryRead(current_, ms)) {
+      skipped_++;
+      active_ = false;
+      return;
+    }
+    read_by_begin_.push_back(ms);
+  }
+  glBeginQuery(GL_TIME_ELAPSED, queries_[current_]);
+  active_ = true;
+}
+
+void GpuTimer::End() {
+  if (active_) {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending_[current_] = true;
+    active_ = false;
+  }
+}
+
+bool GpuTimer::TryRead(size_t slot, double& ms) {
+  if (not pending_[slot] or (active_ and slot == current_)) {
+    return false;
+  }
+  GLint available{0};
+  glGetQueryObjectiv(queries_[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == 0) {
+    return false;
+  }
+  GLuint64 elapsed_ns{0};
+  glGetQueryObjectui64v(queries_[slot], GL_QUERY_RESULT, &elapsed_ns);
+  pending_[slot] = false;
+  ms = static_cast<double>(elapsed_ns) * 1.0e-6;
+  return true;
+}
+
+void FrameProfiler::Record(FramePhase phase, double ms) {
+  if (enabled_) {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    phases_[static_cast<size_t>(phase)].Add(ms);
+  }
+}
+
+void FrameProfiler::BeginGpu() {
+  if (not enabled_) {
+    return;
+  }
+  if (not gpu_timer_) {
+    gpu_timer_ = std::make_unique<GpuTimer>();
+  }
+  gpu_timer_->Begin();
+}
+
+void FrameProfiler::EndGpu() {
+  if (gpu_timer_) {
+    gpu_timer_->End();
+  }
+}
+
+void FrameProfiler::EndFrame() {
+  if (gpu_timer_) {
+    gpu_timer_->Collect([this](double ms) { Record(FramePhase::kGpu, ms); });
+    const std::lock_guard<std::mutex> lock{mutex_};
+    gpu_frames_skipped_ = gpu_timer_->Skipped();
+  }
+}
+
+PhaseSummary FrameProfiler::Summary(FramePhase phase) const {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  return phases_[static_cast<size_t>(phase)].Summarize();
+}
+
+std::ostream& FrameProfiler::WriteJson(std::ostream& out) const {
+  unsigned long gpu_frames_skipped{0};
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    gpu_frames_skipped = gpu_frames_skipped_;
+  }
+  out << std::fixed << std::setprecision(4) << "{\n"
+      << "  \"window\": " << RollingSamples::kWindow << ",\n"
+      << "  \"gpu_frames_skipped\": " << gpu_frames_skipped << ",\n"
+      << "  \"phases\": {\n";
+  for (size_t i = 0; i < kNumFramePhases; i++) {
+    const auto phase{static_cast<FramePhase>(i)};
+    const PhaseSummary s{Summary(phase)};
+    out << "    \"" << FramePhaseToString(phase) << "\": {\"count\": "
+        << s.count << ", \"mean_ms\": " << s.mean_ms
+        << ", \"p50_ms\": " << s.p50_ms << ", \"p95_ms\": " << s.p95_ms
+        << ", \"p99_ms\": " << s.p99_ms << ", \"max_ms\": " << s.max_ms << "}"
+        << (i + 1 < kNumFramePhases ? "," : "") << "\n";
+  }
+  out << "  }\n}\n" << std::defaultfloat;
+  return out;
+}
+
+std::ostream& FrameProfiler::WriteCsv(std::ostream& out) const {
+  out << std::fixed << std::setprecision(4)
+      << "phase,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+  for (size_t i = 0; i < kNumFramePhases; i++) {
+    const auto phase{static_cast<FramePhase>(i)};
+    const PhaseSummary s{Summary(phase)};
+    out << FramePhaseToString(phase) << "," << s.count << "," << s.mean_ms
+        << "," << s.p50_ms << "," << s.p95_ms << "," << s.p99_ms << ","
+        << s.max_ms << "\n";
+  }
+  out << std::defaultfloat;
+  return out;
+}
+
+bool FrameProfiler::Dump(const std::string& path_prefix) const {
+  std::ofstream json{path_prefix + ".json"};
+  std::ofstream csv{path_prefix + ".csv"};
+  if (not json.is_open() or not csv.is_open()) {
+    std::cerr << "Could not write frame timings to " << path_prefix
+              << ".json/.csv\n";
+    return false;
+  }
+  WriteJson(json);
+  WriteCsv(csv);
+  std::cerr << "Frame timings written to " << path_prefix << ".json and "
+            << path_prefix << ".csv\n";
+  return true;
+}
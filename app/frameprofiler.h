@@ -0,0 +1,161 @@
+#ifndef FRAMEPROFILER_H_
+#define FRAMEPROFILER_H_
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "glad/gl.h"
+
+// The parts of a frame that GLFWApp times. kGpu is measured on the GPU with
+// timer queries around Scene::Draw; the rest are CPU wall time.
+enum class FramePhase { kUpdate, kDraw, kSwap, kPollEvents, kGpu, kCount };
+
+constexpr size_t kNumFramePhases{static_cast<size_t>(FramePhase::kCount)};
+
+const char* FramePhaseToString(FramePhase phase);
+
+struct PhaseSummary {
+  size_t count{0};
+  double mean_ms{0.0};
+  double p50_ms{0.0};
+  double p95_ms{0.0};
+  double p99_ms{0.0};
+  double max_ms{0.0};
+};
+
+// Keeps the most recent kWindow samples of one phase so percentiles follow
+// the current behavior of the program rather than its whole history.
+class RollingSamples {
+ public:
+  static constexpr size_t kWindow{1024};
+
+  RollingSamples() { samples_.reserve(kWindow); }
+
+  void Add(double ms);
+
+  PhaseSummary Summarize() const;
+
+ private:
+  std::vector<double> samples_;
+  size_t next_{0};
+};
+
+// Measures GL_TIME_ELAPSED with a ring of kLatency queries. A query is read
+// back only once GL_QUERY_RESULT_AVAILABLE says so, which is normally a
+// couple of frames later; if the oldest query still is not ready when its
+// slot is needed, that frame goes unmeasured instead of stalling.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class GpuTimer {
+ public:
+  static constexpr size_t kLatency{3};
+
+  GpuTimer();
+
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  void Begin();
+
+  void End();
+
+  // Reads every query whose result is ready and hands each to sink in
+  // milliseconds, with any that Begin read first.
+  template <typename Sink>
+  void Collect(Sink sink) {
+    for (const double ms : read_by_begin_) {
+      sink(ms);
+    }
+    read_by_begin_.clear();
+    for (size_t i = 0; i < kLatency; i++) {
+      double ms{0.0};
+      if (TryRead(i, ms)) {
+        sink(ms);
+      }
+    }
+  }
+
+  unsigned long Skipped() const { return skipped_; }
+
+ private:
+  bool TryRead(size_t slot, double& ms);
+
+  std::array<GLuint, kLatency> queries_{};
+  std::array<bool, kLatency> pending_{};
+  // Results that became ready after the last Collect and were read when
+  // Begin needed their slot; often those of the slowest frames.
+  std::vector<double> read_by_begin_;
+  size_t current_{0};
+  bool active_{false};
+  unsigned long skipped_{0};
+};
+
+// Phases may be recorded from different threads when GLFWApp renders on its
+// own thread, so samples are guarded by a mutex.
+class FrameProfiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Times one phase for as long as it is in scope.
+  class Scope {
+   public:
+    Scope(FrameProfiler& profiler, FramePhase phase)
+        : profiler_{profiler}, phase_{phase}, start_{Clock::now()} {}
+    ~Scope() {
+      profiler_.Record(phase_, std::chrono::duration<double, std::milli>(
+                                   Clock::now() - start_)
+                                   .count());
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    Scope(Scope&&) = delete;
+    Scope& operator=(Scope&&) = delete;
+
+   private:
+    FrameProfiler& profiler_;
+    FramePhase phase_;
+    Clock::time_point start_;
+  };
+
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+
+  bool IsEnabled() const { return enabled_; }
+
+  void Record(FramePhase phase, double ms);
+
+  // Bracket the GPU work of a frame. Needs a current GL context.
+  void BeginGpu();
+  void EndGpu();
+
+  // Collects finished GPU timings. Call once per frame after the swap.
+  void EndFrame();
+
+  // Deletes the timer queries; call while the context is still current.
+  void ReleaseGpuResources() { gpu_timer_.reset(); }
+
+  PhaseSummary Summary(FramePhase phase) const;
+
+  std::ostream& WriteJson(std::ostream& out) const;
+
+  std::ostream& WriteCsv(std::ostream& out) const;
+
+  // Writes <path_prefix>.json and <path_prefix>.csv.
+  bool Dump(const std::string& path_prefix) const;
+
+ private:
+  bool enabled_{false};
+  mutable std::mutex mutex_;
+  std::array<RollingSamples, kNumFramePhases> phases_;
+  // Copied from the timer by EndFrame, so that other threads read it
+  // under mutex_; the timer is only used by the drawing thread.
+  unsigned long gpu_frames_skipped_{0};
+  std::unique_ptr<GpuTimer> gpu_timer_;
+};
+
+#endif
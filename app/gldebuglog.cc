@@ -0,0 +1,252 @@
+
+#include "gldebuglog.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "msutil.h"
+
+namespace {
+
+constexpr int kUnknownRank{4};
+
+// How often the formatter wakes up to look for new messages.
+constexpr std::chrono::milliseconds kFormatPeriod{10};
+
+constexpr std::chrono::seconds kRateWindow{1};
+
+// Lower is more severe.
+int SeverityRank(GLenum severity) {
+  switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH:
+      return 0;
+    case GL_DEBUG_SEVERITY_MEDIUM:
+      return 1;
+    case GL_DEBUG_SEVERITY_LOW:
+      return 2;
+    case GL_DEBUG_SEVERITY_NOTIFICATION:
+      return 3;
+    default:
+      return kUnknownRank;
+  }
+}
+
+}  // namespace
+
+GLDebugLog::GLDebugLog(const GLDebugLogOptions& options)
+    : options_{options},
+      min_rank_{SeverityRank(options.min_severity)},
+      slots_{std::make_unique<Slot[]>(kCapacity)} {
+  static_assert((kCapacity & (kCapacity - 1)) == 0,
+                "The ring capacity must be a power of two.");
+  for (size_t i = 0; i < kCapacity; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  formatter_ = std::thread{&GLDebugLog::FormatterLoop, this};
+}
+
+GLDebugLog::~GLDebugLog() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  wake_.notify_one();
+  formatter_.join();
+}
+
+void GLDebugLog::Callback(GLenum source, GLenum type, GLuint id,
+                          GLenum severity, GLsizei length, const GLchar* msg,
+                          const void* param) {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  auto* log{static_cast<GLDebugLog*>(const_cast<void*>(param))};
+  log->Record(source, type, id, severity, length, msg);
+}
+
+void GLDebugLog::Record(GLenum source, GLenum type, GLuint id,
+                        GLenum severity, GLsizei length, const GLchar* msg) {
+  const int rank{SeverityRank(severity)};
+  received_[rank].fetch_add(1, std::memory_order_relaxed);
+  if (rank != kUnknownRank and
+      rank > min_rank_.load(std::memory_order_relaxed)) {
+    filtered_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // Claim a slot. A slot is free when its sequence equals the position
+  // that would write it and full until the formatter hands it back.
+  size_t position{enqueue_position_.load(std::memory_order_relaxed)};
+  Slot* slot{nullptr};
+  while (true) {
+    slot = &slots_[position & (kCapacity - 1)];
+    const size_t sequence{slot->sequence.load(std::memory_order_acquire)};
+    const auto difference{static_cast<std::ptrdiff_t>(sequence - position)};
+    if (difference == 0) {
+      if (enqueue_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+  Message& message{slot->message};
+  message.source = source;
+  message.type = type;
+  message.id = id;
+  message.severity = severity;
+  message.time = Clock::now();
+  const size_t full_length{length < 0 ? std::strlen(msg)
+                                      : static_cast<size_t>(length)};
+  message.length = std::min(full_length, kMaxMessageLength);
+  message.truncated = full_length > kMaxMessageLength;
+  std::memcpy(message.text.data(), msg, message.length);
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void GLDebugLog::SetMinSeverity(GLenum severity) {
+  min_rank_ = SeverityRank(severity);
+}
+
+void GLDebugLog::Flush() {
+  const size_t target{enqueue_position_.load()};
+  std::unique_lock<std::mutex> lock{mutex_};
+  flush_requested_ = true;
+  wake_.notify_one();
+  drained_.wait(lock, [&] { return drained_position_ >= target; });
+}
+
+GLDebugLogCounters GLDebugLog::Counters() const {
+  GLDebugLogCounters counters;
+  for (size_t i = 0; i < received_.size(); i++) {
+    counters.received.at(i) = received_.at(i);
+  }
+  counters.filtered = filtered_;
+  counters.dropped = dropped_;
+  counters.printed = printed_;
+  counters.repeated = repeated_;
+  counters.rate_limited = rate_limited_;
+  return counters;
+}
+
+bool GLDebugLog::TryPop(Message& message) {
+  Slot& slot{slots_[dequeue_position_ & (kCapacity - 1)]};
+  if (slot.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1) {
+    return false;
+  }
+  message = slot.message;
+  slot.sequence.store(dequeue_position_ + kCapacity, std::memory_order_release);
+  dequeue_position_++;
+  return true;
+}
+
+void GLDebugLog::FormatterLoop() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    const bool stopping{stop_};
+    const bool flushing{flush_requested_};
+    flush_requested_ = false;
+    lock.unlock();
+    Message message;
+    while (TryPop(message)) {
+      Handle(message);
+    }
+    EndRateWindows(Clock::now(), stopping);
+    if (stopping or flushing) {
+      EndRepeats();
+    }
+    fflush(options_.out);
+    lock.lock();
+    drained_position_ = dequeue_position_;
+    drained_.notify_all();
+    if (stopping) {
+      break;
+    }
+    wake_.wait_for(lock, kFormatPeriod,
+                   [&] { return stop_ or flush_requested_; });
+  }
+}
+
+void GLDebugLog::Handle(const Message& message) {
+  if (have_last_ and message.source == last_.source and
+      message.type == last_.type and message.id == last_.id and
+      message.length == last_.length and
+      std::memcmp(message.text.data(), last_.text.data(), message.length) ==
+          0) {
+    last_repeats_++;
+    repeated_++;
+    return;
+  }
+  EndRepeats();
+  RateWindow& window{windows_[{message.source, message.type, message.id}]};
+  if (message.time - window.start >= kRateWindow) {
+    if (window.suppressed > 0) {
+      fprintf(options_.out,
+              "GL debug (id: %u): %lu more messages were suppressed\n",
+              message.id, window.suppressed);
+    }
+    window = RateWindow{message.time};
+  }
+  if (options_.max_per_id_per_second > 0 and
+      window.printed >= options_.max_per_id_per_second) {
+    window.suppressed++;
+    rate_limited_++;
+    return;
+  }
+  window.printed++;
+  Print(message);
+  last_ = message;
+  have_last_ = true;
+}
+
+void GLDebugLog::Print(const Message& message) {
+  fprintf(options_.out, "%s(%u):%s(%u) [%s] (id: %u) \"%.*s%s\"\n",
+          ms_util::GLDebugSourceToString(message.source), message.source,
+          ms_util::GLDebugTypeToString(message.type), message.type,
+          ms_util::GLDebugSeverityToString(message.severity), message.id,
+          static_cast<int>(message.length), message.text.data(),
+          message.truncated ? "..." : "");
+  printed_++;
+}
+
+void GLDebugLog::EndRepeats() {
+  if (last_repeats_ > 0) {
+    fprintf(options_.out, "GL debug (id: %u): last message repeated %lu times\n",
+            last_.id, last_repeats_);
+  }
+  last_repeats_ = 0;
+  have_last_ = false;
+}
+
+void GLDebugLog::EndRateWindows(Clock::time_point now, bool all) {
+  for (auto it = windows_.begin(); it != windows_.end();) {
+    if (all or now - it->second.start >= kRateWindow) {
+      if (it->second.suppressed > 0) {
+        fprintf(options_.out,
+                "GL debug (id: %u): %lu more messages were suppressed\n",
+                std::get<2>(it->first), it->second.suppressed);
+      }
+      it = windows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const GLDebugLog& log) {
+  const GLDebugLogCounters counters{log.Counters()};
+  unsigned long received{0};
+  for (const unsigned long count : counters.received) {
+    received += count;
+  }
+  out << "GL debug messages: " << received << " received ("
+      << counters.received[0] << " high, " << counters.received[1]
+      << " medium, " << counters.received[2] << " low, "
+      << counters.received[3] << " notification), " << counters.filtered
+      << " filtered, " << counters.dropped << " dropped, " << counters.printed
+      << " printed, " << counters.repeated << " repeated, "
+      << counters.rate_limited << " rate limited\n";
+  return out;
+}
@@ -0,0 +1,142 @@
+#ifndef GLDEBUGLOG_H_
+#define GLDEBUGLOG_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include "glad/gl.h"
+
+struct GLDebugLogOptions {
+  // Messages less severe than this are counted and dropped in the callback.
+  GLenum min_severity{GL_DEBUG_SEVERITY_NOTIFICATION};
+  // Messages printed per source, type and id each second; the rest are
+  // counted and summarized when the second is over.
+  unsigned int max_per_id_per_second{5};
+  FILE* out{stderr};
+};
+
+struct GLDebugLogCounters {
+  // Messages the driver delivered, by severity: high, medium, low,
+  // notification and unknown.
+  std::array<unsigned long, 5> received{};
+  // Below the minimum severity.
+  unsigned long filtered{0};
+  // Lost because the ring was full.
+  unsigned long dropped{0};
+  unsigned long printed{0};
+  // Identical to the message before them and folded into a repeat count.
+  unsigned long repeated{0};
+  unsigned long rate_limited{0};
+};
+
+// A GL debug message callback that does almost nothing on the driver's
+// thread. The callback copies the raw message into a fixed size lock-free
+// ring buffer; a background thread turns the messages into text, folds
+// repeats of the same message into a count, rate limits each message id,
+// and writes the result. When the ring is full, new messages are dropped
+// and counted rather than blocking the driver.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class GLDebugLog {
+ public:
+  // Must be a power of two.
+  static constexpr size_t kCapacity{1024};
+  // Longer messages are truncated.
+  static constexpr size_t kMaxMessageLength{256};
+
+  explicit GLDebugLog(const GLDebugLogOptions& options = GLDebugLogOptions{});
+
+  // Prints everything still in the ring before returning.
+  ~GLDebugLog();
+
+  GLDebugLog(const GLDebugLog&) = delete;
+  GLDebugLog& operator=(const GLDebugLog&) = delete;
+
+  // Pass to glDebugMessageCallback with the log as the user parameter.
+  static void Callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                       GLsizei length, const GLchar* msg, const void* param);
+
+  // Safe to call from any number of threads at once.
+  void Record(GLenum source, GLenum type, GLuint id, GLenum severity,
+              GLsizei length, const GLchar* msg);
+
+  void SetMinSeverity(GLenum severity);
+
+  // Waits until every message recorded before the call has been handled.
+  void Flush();
+
+  GLDebugLogCounters Counters() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Message {
+    GLenum source;
+    GLenum type;
+    GLuint id;
+    GLenum severity;
+    Clock::time_point time;
+    size_t length;
+    bool truncated;
+    std::array<char, kMaxMessageLength> text;
+  };
+
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Message message;
+  };
+
+  using MessageKey = std::tuple<GLenum, GLenum, GLuint>;
+
+  struct RateWindow {
+    Clock::time_point start;
+    unsigned int printed{0};
+    unsigned long suppressed{0};
+  };
+
+  bool TryPop(Message& message);
+  void FormatterLoop();
+  // The rest run on the formatter thread only.
+  void Handle(const Message& message);
+  void Print(const Message& message);
+  void EndRepeats();
+  void EndRateWindows(Clock::time_point now, bool all);
+
+  GLDebugLogOptions options_;
+  std::atomic<int> min_rank_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> enqueue_position_{0};
+  size_t dequeue_position_{0};
+
+  std::array<std::atomic<unsigned long>, 5> received_{};
+  std::atomic<unsigned long> filtered_{0};
+  std::atomic<unsigned long> dropped_{0};
+  std::atomic<unsigned long> printed_{0};
+  std::atomic<unsigned long> repeated_{0};
+  std::atomic<unsigned long> rate_limited_{0};
+
+  Message last_{};
+  bool have_last_{false};
+  unsigned long last_repeats_{0};
+  std::map<MessageKey, RateWindow> windows_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable drained_;
+  size_t drained_position_{0};
+  bool flush_requested_{false};
+  bool stop_{false};
+  std::thread formatter_;
+};
+
+std::ostream& operator<<(std::ostream& out, const GLDebugLog& log);
+
+#endif
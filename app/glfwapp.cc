@@ -3,11 +3,44 @@
 
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <iomanip>
+#include <limits>
+#include <thread>
+
+#include "hotreload.h"
+#include "programcache.h"
+#include "resourcecache.h"
+#include "shaderlibrary.h"
+#include "streambuffer.h"
+#include "triplebuffer.h"
+
 // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
 GLFWApp::GLFWApp(const std::string& window_title, size_t width, size_t height,
-                 unsigned int fps, bool debug, GLFWerrorfun glfw_err_func)
-    : fps_{fps}, debug_{debug} {
+                 unsigned int fps, bool debug, GLFWerrorfun glfw_err_func,
+                 const HeadlessOptions& headless)
+    : fps_{fps},
+      debug_{debug},
+      headless_{headless},
+      pacer_{fps, PacingPolicy::kSleep} {
   glfwSetErrorCallback(glfw_err_func);
+  bool null_platform{false};
+#if defined(LINUX) && (GLFW_VERSION_MAJOR > 3 || \
+                       (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4))
+  // Without a display, ask for GLFW's null platform and an EGL context so
+  // Mesa can hand us a surfaceless llvmpipe context.
+  if (headless_.enabled and std::getenv("DISPLAY") == nullptr and
+      std::getenv("WAYLAND_DISPLAY") == nullptr and
+      glfwPlatformSupported(GLFW_PLATFORM_NULL) == GLFW_TRUE) {
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    null_platform = true;
+  }
+#endif
   if (glfwInit() == 0) {
     throw GLFWAppException("Could not initialize GLFW.");
   }
@@ -33,9 +66,21 @@ GLFWApp::GLFWApp(const std::string& window_title, size_t width, size_t height,
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-  if (debug) {
+  const ms_util::GLCheckLevel check_level{ms_util::GetGLCheckLevel()};
+  if (check_level == ms_util::GLCheckLevel::kOff) {
+    // A debug context would still validate every call.
+    debug_ = false;
+    glfwWindowHint(GLFW_CONTEXT_NO_ERROR, GLFW_TRUE);
+  }
+  if (debug_) {
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
   }
+  if (headless_.enabled) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+  if (null_platform) {
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+  }
   window_ =
       glfwCreateWindow(width, height, window_title.c_str(), nullptr, nullptr);
   if (window_ == nullptr) {
@@ -59,14 +104,16 @@ GLFWApp::GLFWApp(const std::string& window_title, size_t width, size_t height,
   if (version_ == 0) {
     throw GLFWAppException("Could not load OpenGL functions.");
   }
+  ms_util::ApplyGLCheckLevel();
 
   // Successfully loaded OpenGL
   std::cout << "Loaded OpenGL " << GlVersionMajor() << "." << GlVersionMinor()
             << "\n";
 
-  if (debug && GlVersionMajor() >= 4 && GlVersionMinor() >= 3) {
+  if (debug_ && GlVersionMajor() >= 4 && GlVersionMinor() >= 3) {
     std::cerr << "GL Debugging Callback Enabled.\n";
-    glDebugMessageCallback(ms_util::GLDebugCallback, nullptr);
+    debug_log_ = std::make_unique<GLDebugLog>();
+    glDebugMessageCallback(GLDebugLog::Callback, debug_log_.get());
     glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr,
                           GL_TRUE);
     glDebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_MARKER, 0,
@@ -74,6 +121,15 @@ GLFWApp::GLFWApp(const std::string& window_title, size_t width, size_t height,
   }
 
   ms_util::GLVersion();
+
+  if (headless_.enabled) {
+    offscreen_ = std::make_unique<OffscreenFramebuffer>(width, height);
+    fb_width_ = offscreen_->Width();
+    fb_height_ = offscreen_->Height();
+    std::cerr << "Headless: drawing " << headless_.num_frames
+              << " frames offscreen at " << fb_width_ << "x" << fb_height_
+              << ".\n";
+  }
 };
 
 int GLFWApp::Run(std::shared_ptr<Scene> scene) {
@@ -84,29 +140,86 @@ int GLFWApp::Run(std::shared_ptr<Scene> scene) {
     scene_->SetKeyboard(keyboard);
     status = RunLoop();
   }
+  PrintReports();
   return status;
 }
 
 int GLFWApp::Run() {
   int status{EXIT_FAILURE};
+  if (scene_manager_->Size() > 1 and not scene_loader_) {
+    scene_loader_ = std::make_unique<SceneLoader>(window_);
+  }
   scene_ = scene_manager_->First();
   while (glfwWindowShouldClose(window_) == 0 and scene_ and scene_->IsValid()) {
     std::cerr << *scene_;
     while (glfwWindowShouldClose(window_) == 0 and scene_->IsValid()) {
       scene_->SetMouse(mouse);
       scene_->SetKeyboard(keyboard);
+      if (scene_loader_) {
+        scene_loader_->Prepare(scene_manager_->PeekNext());
+      }
       status = RunLoop();
     }
+    switch_start_ = std::chrono::steady_clock::now();
+    switching_ = true;
     scene_ = scene_manager_->Next();
   }
+  switching_ = false;
+  const PhaseSummary switches{switch_latency_.Summarize()};
+  if (switches.count > 0) {
+    std::cerr << std::fixed << std::setprecision(3)
+              << "Scene switches: " << switches.count << ", mean "
+              << switches.mean_ms << " ms, max " << switches.max_ms << " ms\n"
+              << std::defaultfloat;
+  }
   // if (scene_) {
   //   scene_->SetMouse(mouse);
   //   scene_->SetKeyboard(keyboard);
   //   status = RunLoop();
   // }
+  PrintReports();
   return status;
 }
 
+void GLFWApp::PrintReports() {
+  DumpFrameTimings();
+  ms_util::GLCheckReport();
+  if (debug_log_) {
+    debug_log_->Flush();
+    std::cerr << *debug_log_;
+  }
+  const ProgramCacheStats cache{ProgramBinaryCache::Instance().Stats()};
+  if (cache.hits + cache.misses > 0) {
+    std::cerr << ProgramBinaryCache::Instance();
+  }
+  if (ShaderLibrary::Instance().Stats().requests > 0) {
+    std::cerr << ShaderLibrary::Instance();
+  }
+  if (ResourceCache::Instance().Stats().maps > 0) {
+    std::cerr << ResourceCache::Instance();
+  }
+  const StreamBufferStats streamed{StreamBuffer::TotalStats()};
+  if (streamed.frames > 0) {
+    std::cerr << "Stream buffers: " << streamed << "\n";
+  }
+}
+
+void GLFWApp::CheckFrameErrors() {
+  // Runs in every build, since the cheap tiers are meant for release
+  // builds. The check prints the errors and counts them for
+  // GLCheckReport; debug builds also stop at the first frame that has one.
+  const bool failed{ms_util::GLFrameErrorCheck()};
+  assert(not failed);
+  static_cast<void>(failed);
+}
+
+bool GLFWApp::DumpFrameTimings() const {
+  if (not profiler_.IsEnabled()) {
+    return false;
+  }
+  return profiler_.Dump(profile_path_);
+}
+
 void GLFWApp::SetKeyCallback(GLFWkeyfun callback_func) {
   glfwSetKeyCallback(window_, callback_func);
 }
@@ -126,28 +239,312 @@ void GLFWApp::ToggleAnimation() {
 }
 
 int GLFWApp::RunLoop() {
+  if (headless_.enabled) {
+    return HeadlessRunLoop();
+  }
+  if (threading_ == ThreadingModel::kRenderThread) {
+    return ThreadedRunLoop();
+  }
   scene_->SetDimension(fb_width_, fb_height_);
-  scene_->Begin();
+  BeginScene();
   scene_->Resize(fb_width_, fb_height_);
   curr_time_ = glfwGetTime();
-  // double last_frame_update_time{0};
-  double time_per_frame = 1.0 / fps_;
-  double accumlated_time{0};
+  StartSimulation(curr_time_);
+  pacer_.Start();
   while (glfwWindowShouldClose(window_) == 0 and scene_->IsValid()) {
-    assert(!ms_util::GLErrorCheck());
+    CheckFrameErrors();
+    pacer_.WaitForNextFrame();
     prev_time_ = curr_time_;
     curr_time_ = glfwGetTime();
-    double delta_time = curr_time_ - prev_time_;
-    accumlated_time += delta_time;
-    scene_->Update(curr_time_);
-    if (accumlated_time >= time_per_frame) {
+    {
+      const FrameProfiler::Scope update{profiler_, FramePhase::kUpdate};
+      AdvanceSimulation(curr_time_, curr_time_ - prev_time_);
+    }
+    // Swaps in shader programs rebuilt since the last frame.
+    ShaderReloader::Instance().Update();
+    profiler_.BeginGpu();
+    {
+      const FrameProfiler::Scope draw{profiler_, FramePhase::kDraw};
       scene_->Draw(curr_time_);
+    }
+    profiler_.EndGpu();
+    {
+      const FrameProfiler::Scope swap{profiler_, FramePhase::kSwap};
       glfwSwapBuffers(window_);
-      // last_frame_update_time = curr_time_;
-      accumlated_time = 0.0;
     }
-    glfwPollEvents();
+    EndSceneSwitch();
+    {
+      const FrameProfiler::Scope poll{profiler_, FramePhase::kPollEvents};
+      glfwPollEvents();
+    }
+    profiler_.EndFrame();
+    GLStateCache::Current().EndFrame();
   }
   scene_->End();
+  std::cerr << pacer_.Stats() << GLStateCache::Current();
+  if (dropped_ticks_ > 0) {
+    std::cerr << "Fixed timestep: dropped " << dropped_ticks_
+              << " ticks to stay within the catch-up limit.\n";
+  }
+  return EXIT_SUCCESS;
+}
+
+void GLFWApp::BeginScene() {
+  if (scene_loader_) {
+    scene_loader_->Wait(scene_);
+  }
+  switch_was_prepared_ = scene_->IsPrepared();
+  if (not scene_->IsPrepared()) {
+    scene_->Prepare();
+    scene_->SetPrepared(true);
+  }
+  scene_->Begin();
+}
+
+void GLFWApp::EndSceneSwitch() {
+  if (not switching_) {
+    return;
+  }
+  switching_ = false;
+  const double ms{std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - switch_start_)
+                      .count()};
+  switch_latency_.Add(ms);
+  std::cerr << std::fixed << std::setprecision(3) << "Scene switch: " << ms
+            << " ms"
+            << (switch_was_prepared_ ? "" : " (prepared during the switch)")
+            << "\n"
+            << std::defaultfloat;
+}
+
+void GLFWApp::StartSimulation(double time) {
+  sim_time_ = time;
+  accumulated_time_ = 0.0;
+  dropped_ticks_ = 0;
+  const double tick_delta{
+      fixed_step_.tick_rate > 0 ? 1.0 / fixed_step_.tick_rate : 0.0};
+  scene_->SetTimestep(tick_delta, 1.0);
+}
+
+void GLFWApp::AdvanceSimulation(double time, double delta_time) {
+  if (fixed_step_.tick_rate == 0) {
+    scene_->Update(time);
+    return;
+  }
+  const double tick_delta{1.0 / fixed_step_.tick_rate};
+  accumulated_time_ += delta_time;
+  unsigned int steps{0};
+  while (accumulated_time_ >= tick_delta and
+         steps < fixed_step_.max_catch_up_steps) {
+    sim_time_ += tick_delta;
+    scene_->Update(sim_time_);
+    accumulated_time_ -= tick_delta;
+    steps++;
+  }
+  if (accumulated_time_ >= tick_delta) {
+    // The simulation falls behind the wall clock rather than stalling
+    // rendering.
+    const double dropped{std::floor(accumulated_time_ / tick_delta)};
+    dropped_ticks_ += static_cast<unsigned long>(dropped);
+    accumulated_time_ -= dropped * tick_delta;
+  }
+  scene_->SetTimestep(tick_delta, accumulated_time_ / tick_delta);
+}
+
+int GLFWApp::HeadlessRunLoop() {
+  using Clock = std::chrono::steady_clock;
+  offscreen_->Bind();
+  scene_->SetDimension(fb_width_, fb_height_);
+  BeginScene();
+  scene_->Resize(fb_width_, fb_height_);
+  const double time_per_frame = 1.0 / fps_;
+  double cpu_total{0.0};
+  double cpu_min{std::numeric_limits<double>::max()};
+  double cpu_max{0.0};
+  unsigned int frame{0};
+  curr_time_ = 0.0;
+  StartSimulation(curr_time_);
+  const Clock::time_point start{Clock::now()};
+  while (frame < headless_.num_frames and scene_->IsValid()) {
+    CheckFrameErrors();
+    // The simulated clock makes every run see the same sequence of times.
+    prev_time_ = curr_time_;
+    curr_time_ = frame * time_per_frame;
+    const Clock::time_point frame_start{Clock::now()};
+    offscreen_->Bind();
+    {
+      const FrameProfiler::Scope update{profiler_, FramePhase::kUpdate};
+      AdvanceSimulation(curr_time_, curr_time_ - prev_time_);
+    }
+    // Swaps in shader programs rebuilt since the last frame.
+    ShaderReloader::Instance().Update();
+    profiler_.BeginGpu();
+    {
+      const FrameProfiler::Scope draw{profiler_, FramePhase::kDraw};
+      scene_->Draw(curr_time_);
+    }
+    profiler_.EndGpu();
+    glFlush();
+    EndSceneSwitch();
+    const double cpu_time{
+        std::chrono::duration<double>(Clock::now() - frame_start).count()};
+    cpu_total += cpu_time;
+    cpu_min = std::min(cpu_min, cpu_time);
+    cpu_max = std::max(cpu_max, cpu_time);
+    {
+      const FrameProfiler::Scope poll{profiler_, FramePhase::kPollEvents};
+      glfwPollEvents();
+    }
+    profiler_.EndFrame();
+    GLStateCache::Current().EndFrame();
+    frame++;
+  }
+  glFinish();
+  profiler_.EndFrame();
+  const double elapsed{
+      std::chrono::duration<double>(Clock::now() - start).count()};
+  scene_->End();
+
+  if (frame > 0) {
+    std::cerr << std::fixed << std::setprecision(3)
+              << "Headless: " << frame << " frames in " << elapsed << " s ("
+              << (frame / elapsed) << " frames/sec)\n"
+              << "Headless: CPU time per frame (ms): mean "
+              << (1000.0 * cpu_total / frame) << " min " << (1000.0 * cpu_min)
+              << " max " << (1000.0 * cpu_max) << "\n"
+              << std::defaultfloat;
+  }
+  std::cerr << GLStateCache::Current();
+  if (dropped_ticks_ > 0) {
+    std::cerr << "Fixed timestep: dropped " << dropped_ticks_
+              << " ticks to stay within the catch-up limit.\n";
+  }
+  if (frame >= headless_.num_frames) {
+    glfwSetWindowShouldClose(window_, GLFW_TRUE);
+  }
+  return EXIT_SUCCESS;
+}
+
+int GLFWApp::ThreadedRunLoop() {
+  scene_->SetDimension(fb_width_, fb_height_);
+  TripleBuffer<std::shared_ptr<const SceneSnapshot>> snapshots;
+  std::atomic<bool> running{true};
+  std::promise<void> started;
+  std::future<void> started_future{started.get_future()};
+  std::exception_ptr render_error;
+  // glfwWaitEventsTimeout may only be called from the main thread.
+  const PacingPolicy policy{pacer_.Policy()};
+  if (policy == PacingPolicy::kWaitEvents) {
+    pacer_.SetPolicy(PacingPolicy::kSleep);
+  }
+
+  glfwMakeContextCurrent(nullptr);
+  std::thread render_thread{[&] {
+    glfwMakeContextCurrent(window_);
+    GLStateCache::Current().Invalidate();
+    // However the thread leaves, the scene is ended and the context is
+    // released on it. An End that throws after an earlier error is
+    // ignored; the earlier error is the one reported.
+    // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+    struct Finish {
+      Scene* scene{nullptr};
+      ~Finish() {
+        if (scene != nullptr) {
+          try {
+            scene->End();
+          } catch (...) {
+            // Already failing.
+          }
+        }
+        glfwMakeContextCurrent(nullptr);
+      }
+    } finish;
+    try {
+      finish.scene = scene_.get();
+      BeginScene();
+      scene_->Resize(fb_width_, fb_height_);
+      started.set_value();
+    } catch (...) {
+      started.set_exception(std::current_exception());
+      return;
+    }
+    try {
+      pacer_.Start();
+      while (running) {
+        CheckFrameErrors();
+        pacer_.WaitForNextFrame();
+        snapshots.Update();
+        const std::shared_ptr<const SceneSnapshot>& snapshot{
+            snapshots.Front()};
+        if (not snapshot) {
+          continue;
+        }
+        // Swaps in shader programs rebuilt since the last frame.
+        ShaderReloader::Instance().Update();
+        profiler_.BeginGpu();
+        {
+          const FrameProfiler::Scope draw{profiler_, FramePhase::kDraw};
+          scene_->DrawSnapshot(*snapshot);
+        }
+        profiler_.EndGpu();
+        {
+          const FrameProfiler::Scope swap{profiler_, FramePhase::kSwap};
+          glfwSwapBuffers(window_);
+        }
+        EndSceneSwitch();
+        profiler_.EndFrame();
+        GLStateCache::Current().EndFrame();
+      }
+      // An error from End itself is reported.
+      finish.scene = nullptr;
+      scene_->End();
+      std::cerr << GLStateCache::Current();
+    } catch (...) {
+      render_error = std::current_exception();
+      running = false;
+    }
+  }};
+
+  try {
+    started_future.get();
+  } catch (...) {
+    render_thread.join();
+    glfwMakeContextCurrent(window_);
+    GLStateCache::Current().Invalidate();
+    pacer_.SetPolicy(policy);
+    throw;
+  }
+
+  // The main thread paces itself by waiting for events.
+  FramePacer update_pacer{fps_, PacingPolicy::kWaitEvents};
+  update_pacer.Start();
+  curr_time_ = glfwGetTime();
+  StartSimulation(curr_time_);
+  while (running and glfwWindowShouldClose(window_) == 0 and
+         scene_->IsValid()) {
+    update_pacer.WaitForNextFrame();
+    {
+      const FrameProfiler::Scope poll{profiler_, FramePhase::kPollEvents};
+      glfwPollEvents();
+    }
+    prev_time_ = curr_time_;
+    curr_time_ = glfwGetTime();
+    {
+      const FrameProfiler::Scope update{profiler_, FramePhase::kUpdate};
+      AdvanceSimulation(curr_time_, curr_time_ - prev_time_);
+      snapshots.Back() = scene_->Snapshot(curr_time_);
+    }
+    snapshots.Publish();
+  }
+  running = false;
+  render_thread.join();
+  glfwMakeContextCurrent(window_);
+  // The render thread changed the context's state behind this thread's back.
+  GLStateCache::Current().Invalidate();
+  pacer_.SetPolicy(policy);
+  if (render_error) {
+    std::rethrow_exception(render_error);
+  }
+  std::cerr << pacer_.Stats();
   return EXIT_SUCCESS;
 }
@@ -9,18 +9,53 @@
 #include <GLFW/glfw3.h>
 
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 
+#include "framepacer.h"
+#include "frameprofiler.h"
+#include "gldebuglog.h"
+#include "glstate.h"
 #include "hid.h"
+#include "hotreload.h"
 #include "msutil.h"
+#include "offscreen.h"
 #include "scene.h"
+#include "sceneloader.h"
 
 constexpr int kDefaultWindowWidth{600};
 constexpr int kDefaultWindowHeight{600};
 // #define MS_DEFAULT_WINDOW_WIDTH 600
 // #define MS_DEFAULT_WINDOW_HEIGHT 600
+// Run without a visible window, e.g. on a CI machine without a GPU or a
+// display. Scenes draw into an offscreen framebuffer for exactly num_frames
+// frames and time advances by 1/fps per frame instead of following the wall
+// clock. When there is no display and GLFW is 3.4 or newer, the null platform
+// is used with an EGL context (surfaceless on Mesa llvmpipe); otherwise a
+// hidden window is created, which works under xvfb-run.
+struct HeadlessOptions {
+  bool enabled{false};
+  unsigned int num_frames{300};
+};
+
+// Run Scene::Update at a fixed rate that does not depend on the frame rate.
+// Each frame runs as many ticks as the elapsed time covers, but no more than
+// max_catch_up_steps; time beyond that is dropped so a slow machine does not
+// spiral. A tick_rate of 0 updates once per frame.
+struct FixedTimestep {
+  unsigned int tick_rate{0};
+  unsigned int max_catch_up_steps{5};
+};
+
+// kSingleThread polls events, updates, draws and swaps on the main thread.
+// kRenderThread moves the GL context to a render thread that draws and
+// swaps while the main thread polls events and updates the scene; the two
+// exchange Scene::Snapshot results through a triple buffer. Headless runs
+// always use a single thread.
+enum class ThreadingModel { kSingleThread, kRenderThread };
+
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
 class GLFWAppException : public std::runtime_error {
  public:
@@ -39,9 +74,14 @@ class GLFWApp {
                    size_t width = kDefaultWindowWidth,
                    size_t height = kDefaultWindowHeight, unsigned int fps = 60,
                    bool debug = true,
-                   GLFWerrorfun glfw_err_func = ms_util::GLFWErrorCallback);
+                   GLFWerrorfun glfw_err_func = ms_util::GLFWErrorCallback,
+                   const HeadlessOptions& headless = HeadlessOptions{});
 
   virtual ~GLFWApp() {
+    ShaderReloader::Instance().Disable();
+    profiler_.ReleaseGpuResources();
+    scene_loader_.reset();
+    offscreen_.reset();
     if (window_ != nullptr) {
       glfwDestroyWindow(window_);
     }
@@ -60,6 +100,8 @@ class GLFWApp {
 
   int Run(std::shared_ptr<Scene> scene);
 
+  // Runs the scene manager's scenes in turn. While a scene runs, the next
+  // one is prepared on a loader thread.
   int Run();
 
   void SetKeyCallback(GLFWkeyfun callback_func);
@@ -74,8 +116,45 @@ class GLFWApp {
 
   int GlVersionMinor() const { return GLAD_VERSION_MINOR(version_); }
 
+  bool IsHeadless() const { return headless_.enabled; }
+
+  void SetPacingPolicy(PacingPolicy policy) { pacer_.SetPolicy(policy); }
+
+  const FramePacer& Pacer() const { return pacer_; }
+
+  void SetFixedTimestep(const FixedTimestep& fixed_step) {
+    fixed_step_ = fixed_step;
+  }
+
+  // Time each phase of every frame and write the percentiles to
+  // <path_prefix>.json and <path_prefix>.csv when Run returns or when
+  // DumpFrameTimings is called.
+  void SetProfiling(bool enabled,
+                    const std::string& path_prefix = "frame_timings") {
+    profiler_.SetEnabled(enabled);
+    profile_path_ = path_prefix;
+  }
+
+  bool DumpFrameTimings() const;
+
+  void SetThreadingModel(ThreadingModel threading) { threading_ = threading; }
+
+  const FrameProfiler& Profiler() const { return profiler_; }
+
+  // Null unless the context has a debug message callback.
+  GLDebugLog* DebugLog() { return debug_log_.get(); }
+
  private:
   int RunLoop();
+  int HeadlessRunLoop();
+  int ThreadedRunLoop();
+  void PrintReports();
+  // The per-frame GL error check of the current check level.
+  void CheckFrameErrors();
+  void BeginScene();
+  void EndSceneSwitch();
+  void StartSimulation(double time);
+  void AdvanceSimulation(double time, double delta_time);
   GLFWwindow* window_;
   int fb_width_;
   int fb_height_;
@@ -84,7 +163,24 @@ class GLFWApp {
   unsigned int fps_;
   bool debug_;
   int version_;
+  HeadlessOptions headless_;
+  FramePacer pacer_;
+  FixedTimestep fixed_step_;
+  FrameProfiler profiler_;
+  ThreadingModel threading_{ThreadingModel::kSingleThread};
+  std::string profile_path_;
+  double sim_time_{0.0};
+  double accumulated_time_{0.0};
+  unsigned long dropped_ticks_{0};
+  std::unique_ptr<GLDebugLog> debug_log_;
+  std::unique_ptr<OffscreenFramebuffer> offscreen_;
   std::unique_ptr<SceneManager> scene_manager_;
+  std::unique_ptr<SceneLoader> scene_loader_;
+  // From leaving one scene to presenting the first frame of the next.
+  std::chrono::steady_clock::time_point switch_start_;
+  bool switching_{false};
+  bool switch_was_prepared_{false};
+  RollingSamples switch_latency_;
   std::shared_ptr<Scene> scene_;
 };
 
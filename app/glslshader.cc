@@ -1,7 +1,32 @@
 
 #include "glslshader.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstring>
+
+#include "glstate.h"
+#include "hotreload.h"
+#include "programcache.h"
+#include "shaderlibrary.h"
+
+namespace {
+
+// What identifies a stage's source in a program binary cache key.
+std::string CacheKeySource(const ShaderSource& source) {
+  if (not source.spirv) {
+    return source.text;
+  }
+  std::string key{"spirv\n"};
+  for (const SpecializationConstant& constant : source.constants) {
+    key += std::to_string(constant.id) + "=" + std::to_string(constant.value) +
+           "\n";
+  }
+  return key + source.text;
+}
+
+}  // namespace
 
 void GetInfoLog(GLuint id, std::string& log) {
   GLint info_log_length{0};
@@ -74,15 +99,27 @@ std::string ShaderTypeToString(shader_t shader_type) {
   return type_string;
 }
 
-Shader::Shader(const std::string& src_file_path, shader_t shader_type)
-    : src_file_path_{src_file_path}, shader_type_{shader_type}, id_{0} {
-  if (!ms_util::FileToString(src_file_path_, src_)) {
+std::string ReadShaderSource(const std::string& src_file_path) {
+  std::string src;
+  if (!ms_util::FileToString(src_file_path, src)) {
     std::ostringstream msg;
-    msg << "Could not open and load shader source path " << src_file_path_
+    msg << "Could not open and load shader source path " << src_file_path
         << ".\n";
     // fprintf(stderr, "%s\n", msg.str().c_str());
     throw GLSLException(msg.str());
   }
+  return src;
+}
+
+Shader::Shader(const std::string& src_file_path, shader_t shader_type)
+    : Shader(src_file_path, shader_type, ReadShaderSource(src_file_path)) {}
+
+Shader::Shader(const std::string& src_file_path, shader_t shader_type,
+               const std::string& src, bool check_status)
+    : src_file_path_{src_file_path},
+      shader_type_{shader_type},
+      id_{0},
+      src_{src} {
   id_ = glCreateShader(shader_type_);
   if (id_ == 0) {
     // fprintf(stderr, "Can't generate vertex shader.\n");
@@ -92,17 +129,70 @@ Shader::Shader(const std::string& src_file_path, shader_t shader_type)
     throw GLSLException(msg.str());
   }
   ms_util::GLErrorCheck();
-  CompileShader();
+  SubmitCompile();
+  if (check_status) {
+    CheckCompileStatus();
+  }
   ms_util::GLErrorCheck();
 }
 
+Shader::Shader(const std::string& src_file_path, shader_t shader_type,
+               const std::string& spirv,
+               const std::vector<SpecializationConstant>& constants,
+               bool check_status)
+    : src_file_path_{src_file_path},
+      shader_type_{shader_type},
+      id_{0},
+      src_{spirv},
+      spirv_{true},
+      constants_{constants} {
+  id_ = glCreateShader(shader_type_);
+  if (id_ == 0) {
+    std::ostringstream msg;
+    msg << "Can't create a " << ShaderTypeToString(shader_type_) << ".\n";
+    throw GLSLException(msg.str());
+  }
+  ms_util::GLErrorCheck();
+  SubmitCompile();
+  if (check_status) {
+    CheckCompileStatus();
+  }
+}
+
 bool Shader::CompileShader() {
-  GLint compiled_ok{-1};
+  SubmitCompile();
+  return CheckCompileStatus();
+}
+
+void Shader::SubmitCompile() {
+  if (spirv_) {
+    glShaderBinary(1, &id_, GL_SHADER_BINARY_FORMAT_SPIR_V, src_.data(),
+                   static_cast<GLsizei>(src_.size()));
+    std::vector<GLuint> ids;
+    std::vector<GLuint> values;
+    for (const SpecializationConstant& constant : constants_) {
+      ids.push_back(constant.id);
+      values.push_back(constant.value);
+    }
+    // Specializing takes the place of compiling.
+    if (GLAD_GL_VERSION_4_6 != 0) {
+      glSpecializeShader(id_, "main", ids.size(), ids.data(), values.data());
+    } else {
+      glSpecializeShaderARB(id_, "main", ids.size(), ids.data(),
+                            values.data());
+    }
+    ms_util::GLErrorCheck();
+    return;
+  }
   const GLint length{static_cast<GLint>(src_.size())};
   const char* c_str{src_.c_str()};
   glShaderSource(id_, 1, &c_str, &length);
   glCompileShader(id_);
   ms_util::GLErrorCheck();
+}
+
+bool Shader::CheckCompileStatus() noexcept(false) {
+  GLint compiled_ok{-1};
   glGetShaderiv(id_, GL_COMPILE_STATUS, &compiled_ok);
   ms_util::GLErrorCheck();
   if (compiled_ok == 0) {
@@ -136,10 +226,12 @@ GLSLProgram::GLSLProgram() : id_{glCreateProgram()}, linked_{false} {
 }
 
 GLSLProgram::~GLSLProgram() {
+  ShaderReloader::Instance().Unwatch(*this);
   if (id_ == 0) {
     return;
   }
   DetachAll();
+  GLStateCache::Current().ForgetProgram(id_);
   glDeleteProgram(id_);
 }
 
@@ -161,11 +253,73 @@ bool GLSLProgram::DetachAll() const {
   return (ret);
 }
 
+void GLSLProgram::Attach(std::shared_ptr<Shader> stage) {
+  glAttachShader(id_, stage->Id());
+  ms_util::GLErrorCheck();
+  stages_.push_back(std::move(stage));
+}
+
+void GLSLProgram::Swap(GLSLProgram& other) {
+  std::swap(id_, other.id_);
+  std::swap(linked_, other.linked_);
+  std::swap(link_pending_, other.link_pending_);
+  std::swap(cache_key_, other.cache_key_);
+  std::swap(link_submitted_, other.link_submitted_);
+  stages_.swap(other.stages_);
+  std::swap(reflection_, other.reflection_);
+  shadow_slots_.swap(other.shadow_slots_);
+  shadow_.swap(other.shadow_);
+  generation_++;
+  other.generation_++;
+  // Block bindings belong to the program object, so give the new one the
+  // bindings this program had.
+  if (linked_) {
+    for (const auto& [block, binding] : block_bindings_) {
+      const ReflectedBlock* found{reflection_.FindBlock(block)};
+      if (found != nullptr) {
+        glUniformBlockBinding(id_, found - reflection_.Blocks().data(),
+                              binding);
+        reflection_.SetBlockBinding(*found, binding);
+      }
+    }
+  }
+}
+
 void GLSLProgram::Link() noexcept(false) {
-  GLint linked_ok{-1};
-  // bool ret{true};
+  glLinkProgram(id_);
+  link_pending_ = true;
+  CheckLinkStatus();
+}
 
+void GLSLProgram::LinkDeferred(uint64_t cache_key) {
   glLinkProgram(id_);
+  link_pending_ = true;
+  cache_key_ = cache_key;
+  link_submitted_ = std::chrono::steady_clock::now();
+}
+
+bool GLSLProgram::IsLinkComplete() const {
+  if (not link_pending_ or (GLAD_GL_KHR_parallel_shader_compile == 0 and
+                            GLAD_GL_ARB_parallel_shader_compile == 0)) {
+    return true;
+  }
+  GLint complete{GL_TRUE};
+  glGetProgramiv(id_, GL_COMPLETION_STATUS_KHR, &complete);
+  return complete == GL_TRUE;
+}
+
+void GLSLProgram::CheckLinkStatus() noexcept(false) {
+  if (not link_pending_) {
+    return;
+  }
+  link_pending_ = false;
+  // A stage that did not compile explains a failed link better than the
+  // link log does.
+  for (const auto& stage : stages_) {
+    stage->CheckCompileStatus();
+  }
+  GLint linked_ok{-1};
+  // bool ret{true};
 
   glGetProgramiv(id_, GL_LINK_STATUS, &linked_ok);
   if (linked_ok == 0) {
@@ -185,290 +339,300 @@ void GLSLProgram::Link() noexcept(false) {
     // free(msg);
   }
   linked_ = true;
+  FindUniformLocations();
+  if (cache_key_ != 0) {
+    // With deferred checks this also counts time the driver spent on other
+    // programs, so it overstates the cost of this one.
+    const double compile_ms{std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() -
+                                link_submitted_)
+                                .count()};
+    ProgramBinaryCache::Instance().Store(cache_key_, *this, compile_ms);
+    cache_key_ = 0;
+  }
+}
+
+bool GLSLProgram::LoadBinary(GLenum format, const void* binary,
+                             GLsizei length,
+                             const ProgramReflection* reflection) {
+  GLint linked_ok{0};
+  glProgramBinary(id_, format, binary, length);
+  glGetProgramiv(id_, GL_LINK_STATUS, &linked_ok);
+  if (linked_ok == 0) {
+    // Some drivers reject an unknown format with GL_INVALID_ENUM; the
+    // caller falls back to linking from source, so it is not an error.
+    while (glGetError() != GL_NO_ERROR) {
+    }
+  }
+  linked_ = (linked_ok != 0);
+  if (linked_ and reflection != nullptr) {
+    reflection_ = *reflection;
+    ResetUniformShadow();
+    generation_++;
+  } else if (linked_) {
+    FindUniformLocations();
+  }
+  return linked_;
+}
+
+bool GLSLProgram::GetBinary(GLenum& format, std::vector<char>& binary) const {
+  GLint length{0};
+  glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+  binary.resize(length);
+  GLsizei written{0};
+  glGetProgramBinary(id_, length, &written, &format, binary.data());
+  binary.resize(written);
+  return (written > 0 and !ms_util::GLErrorCheck());
 }
 
 bool GLSLProgram::Activate() {
+  CheckLinkStatus();
   ActivateUniforms();
   ms_util::GLErrorCheck();
-  glUseProgram(id_);
+  GLStateCache::Current().UseProgram(id_);
   return (!ms_util::GLErrorCheck());
 }
 
 bool GLSLProgram::Deactivate() {
-  glUseProgram(0);
+  GLStateCache::Current().UseProgram(0);
   return (!ms_util::GLErrorCheck());
 }
 
 bool GLSLProgram::IsActive() const {
-  int id{-1};
-  glGetIntegerv(GL_CURRENT_PROGRAM, &id);
-  return (id == id_);
+  return (GLStateCache::Current().CurrentProgram() == id_);
 }
 
 void GLSLProgram::FindUniformLocations() {
-  uniform_locations_.clear();
-  GLint num_uniforms{0};
-  // For OpenGL 3.3 or 4.1, use glGetActiveUniform
-  // OpenGL 4.3 and above, use glGetProgramResource
-
-  GLint max_length{-1};
-  GLchar* name{nullptr};
+  reflection_ = ProgramReflection::Query(id_);
+  ResetUniformShadow();
+  // Uniform handles made before a deferred link resolved to -1.
+  generation_++;
+}
 
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &num_uniforms);
+void GLSLProgram::ResetUniformShadow() {
+  // Elements of an array take the locations after the first one.
+  size_t num_locations{0};
+  for (const ReflectedUniform& uniform : reflection_.Uniforms()) {
+    if (uniform.location >= 0) {
+      num_locations = std::max(num_locations,
+                               static_cast<size_t>(uniform.location) +
+                                   static_cast<size_t>(uniform.size));
+    }
+  }
+  shadow_slots_.assign(num_locations, ShadowSlot{});
+  shadow_.clear();
+}
 
-  name = new GLchar[max_length];
-  for (GLuint i = 0; i < num_uniforms; i++) {
-    GLint size{0};
-    GLenum type{0};
-    GLsizei written{0};
-    glGetActiveUniform(id_, i, max_length, &written, &size, &type, name);
-    const GLint location{glGetUniformLocation(id_, name)};
-    uniform_locations_[name] = location;
+bool GLSLProgram::ShadowUniform(GLint location, const void* value,
+                                size_t size) {
+  GLStateCache& cache{GLStateCache::Current()};
+  const auto index{static_cast<size_t>(location)};
+  if (index >= shadow_slots_.size()) {
+    cache.CountUniformWrite(true);
+    return true;
   }
-  delete[] name;
+  ShadowSlot& slot{shadow_slots_[index]};
+  if (slot.size == 0) {
+    slot = ShadowSlot{static_cast<uint32_t>(shadow_.size()),
+                      static_cast<uint32_t>(size)};
+    shadow_.resize(shadow_.size() + size);
+  } else if (slot.size != size) {
+    // A value of the wrong type, which GL reports as an error.
+    cache.CountUniformWrite(true);
+    return true;
+  } else if (std::memcmp(shadow_.data() + slot.offset, value, size) == 0) {
+    cache.CountUniformWrite(false);
+    return false;
+  }
+  std::memcpy(shadow_.data() + slot.offset, value, size);
+  cache.CountUniformWrite(true);
+  return true;
+}
+
+GLint GLSLProgram::UniformLocation(uint64_t name_hash) const {
+  return reflection_.UniformLocation(name_hash);
 }
 
 int GLSLProgram::GetUniformLocation(const char* name) {
-  auto pos = uniform_locations_.find(name);
-  if (pos == uniform_locations_.end()) {
-    const GLint loc{glGetUniformLocation(id_, name)};
-    uniform_locations_[name] = loc;
+  CheckLinkStatus();
+  const uint64_t hash{ms_util::Fnv1a64(name)};
+  GLint loc{reflection_.UniformLocation(hash)};
+  if (loc >= 0) {
     return loc;
   }
-  return pos->second;
+  // Not an active uniform by that name, such as an element of an array;
+  // ask once and remember the answer.
+  loc = glGetUniformLocation(id_, name);
+  if (linked_ and loc >= 0) {
+    reflection_.AddUniformLocation(hash, loc);
+  }
+  return loc;
 }
 
 void GLSLProgram::SetUniform(const char* name, const float scalar) {
-  const GLint loc{GetUniformLocation(name)};
-  glUniform1f(loc, scalar);
+  WriteUniform(GetUniformLocation(name), scalar);
 }
 
 void GLSLProgram::SetUniform(const char* name, const glm::vec3& vec) {
-  const GLint loc{GetUniformLocation(name)};
-  glUniform3fv(loc, 1, glm::value_ptr(vec));
+  WriteUniform(GetUniformLocation(name), vec);
 }
 void GLSLProgram::SetUniform(const char* name, const glm::vec4& vec) {
-  const GLint loc{GetUniformLocation(name)};
-  glUniform4fv(loc, 1, glm::value_ptr(vec));
+  WriteUniform(GetUniformLocation(name), vec);
 }
 void GLSLProgram::SetUniform(const char* name, const glm::mat3& mat) {
-  const GLint loc{GetUniformLocation(name)};
-  glUniformMatrix3fv(loc, 1, GL_FALSE, &mat[0][0]);
+  WriteUniform(GetUniformLocation(name), mat);
 }
 void GLSLProgram::SetUniform(const char* name, const glm::mat4& mat) {
-  const GLint loc{GetUniformLocation(name)};
-  glUniformMatrix4fv(loc, 1, GL_FALSE, &mat[0][0]);
+  WriteUniform(GetUniformLocation(name), mat);
 }
 
 void GLSLProgram::PrintActiveUniforms() const {
-#ifdef __APPLE__
-  // For OpenGL 4.1, use glGetActiveUniform
-  GLint num_uniforms{0};
-  GLint size{0};
-  GLint location{0};
-  GLint max_len{0};
-  GLchar* name{nullptr};
-  GLsizei written{0};
-  GLenum type{0};
+  reflection_.PrintUniforms(std::cout);
+}
 
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &num_uniforms);
+bool GLSLProgram::BindUniformBlock(const char* block, GLuint binding) {
+  const ReflectedBlock* found_block{reflection_.FindBlock(block)};
+  if (found_block == nullptr) {
+    return false;
+  }
+  glUniformBlockBinding(id_, found_block - reflection_.Blocks().data(),
+                        binding);
+  reflection_.SetBlockBinding(*found_block, binding);
+  auto found{std::find_if(
+      block_bindings_.begin(), block_bindings_.end(),
+      [&](const auto& bound) { return bound.first == block; })};
+  if (found == block_bindings_.end()) {
+    block_bindings_.emplace_back(block, binding);
+  } else {
+    found->second = binding;
+  }
+  return true;
+}
 
-  name = new GLchar[max_len];
+void GLSLProgram::PrintActiveUniformBlocks() const {
+  reflection_.PrintBlocks(std::cout);
+}
 
-  std::cout << "Active uniforms:\n";
-  std::cout << "------------------------------------------------\n";
-  for (GLuint i = 0; i < num_uniforms; ++i) {
-    glGetActiveUniform(id_, i, max_len, &written, &size, &type, name);
-    location = glGetUniformLocation(id_, name);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-    printf(" %-5d %s (%s)\n", location, name, GetTypeString(type));
+void GLSLProgram::PrintActiveAttribs() const {
+  reflection_.PrintAttributes(std::cout);
+}
+
+void ShaderBatch::Add(GLSLProgram& program,
+                      const std::string& vertex_shader_source_path,
+                      const std::string& fragment_shader_source_path,
+                      const std::vector<std::string>& defines,
+                      SpirvUse spirv) {
+  ShaderLibrary& library{ShaderLibrary::Instance()};
+  Entry entry{&program, vertex_shader_source_path, fragment_shader_source_path,
+              defines, {}, {}};
+  // Both stages come from SPIR-V or both from GLSL.
+  if (spirv == SpirvUse::kNever or
+      not library.LoadSpirv(vertex_shader_source_path, defines,
+                            entry.vertex_src) or
+      not library.LoadSpirv(fragment_shader_source_path, defines,
+                            entry.fragment_src)) {
+    entry.vertex_src = library.Load(vertex_shader_source_path, defines);
+    entry.fragment_src = library.Load(fragment_shader_source_path, defines);
   }
-  std::cout << "------------------------------------------------\n";
-  delete[] name;
-#else
-  // For OpenGL 4.3 and above, use glGetProgramResource
-  GLint num_uniforms{0};
-  glGetProgramInterfaceiv(id_, GL_UNIFORM, GL_ACTIVE_RESOURCES, &num_uniforms);
-
-  GLenum properties[] = {GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_BLOCK_INDEX};
-
-  printf("Active uniforms:\n");
-  std::cout << "------------------------------------------------\n";
-  for (int i = 0; i < num_uniforms; ++i) {
-    GLint results[4];
-    glGetProgramResourceiv(id_, GL_UNIFORM, i, 4, properties, 4, NULL, results);
-
-    if (results[3] != -1) continue;  // Skip uniforms in blocks
-    GLint nameBufSize = results[0] + 1;
-    char* name = new char[nameBufSize];
-    glGetProgramResourceName(id_, GL_UNIFORM, i, nameBufSize, NULL, name);
-    printf("%-5d %s (%s)\n", results[2], name, GetTypeString(results[1]));
-    delete[] name;
-  }
-  std::cout << "------------------------------------------------\n";
-#endif
+  entries_.push_back(std::move(entry));
 }
 
-void GLSLProgram::PrintActiveUniformBlocks() const {
-#ifdef __APPLE__
-  // For OpenGL 4.1, use glGetActiveUniformBlockiv
-  GLint written{0};
-  GLint max_length{0};
-  GLint max_uniform_length{0};
-  GLint n_blocks{0};
-  GLint binding{0};
-  GLchar* name{nullptr};
-
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORM_BLOCKS, &n_blocks);
-  glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_uniform_length);
-  auto* uni_name = new GLchar[max_uniform_length];
-  name = new GLchar[max_length];
-
-  std::cout << "Active Uniform blocks: \n";
-  std::cout << "------------------------------------------------\n";
-  for (GLuint i = 0; i < n_blocks; i++) {
-    glGetActiveUniformBlockName(id_, i, max_length, &written, name);
-    glGetActiveUniformBlockiv(id_, i, GL_UNIFORM_BLOCK_BINDING, &binding);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-    printf("Uniform block \"%s\" (%d):\n", name, binding);
-
-    GLint n_unis{-1};
-    glGetActiveUniformBlockiv(id_, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS,
-                              &n_unis);
-    auto* unif_indexes = new GLint[n_unis];
-    glGetActiveUniformBlockiv(id_, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES,
-                              unif_indexes);
-
-    for (int unif = 0; unif < n_unis; ++unif) {
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-      const GLuint uni_index = unif_indexes[unif];
-      GLint size{-1};
-      GLenum type{0};
-
-      glGetActiveUniform(id_, uni_index, max_uniform_length, &written, &size,
-                         &type, uni_name);
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-      printf("    %s (%s)\n", name, GetTypeString(type));
+size_t ShaderBatch::Submit() noexcept(false) {
+  // Let the driver use as many compiler threads as it likes.
+  if (GLAD_GL_KHR_parallel_shader_compile != 0) {
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  } else if (GLAD_GL_ARB_parallel_shader_compile != 0) {
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+  ProgramBinaryCache& cache{ProgramBinaryCache::Instance()};
+  std::vector<uint64_t> keys(entries_.size(), 0);
+  size_t cached{0};
+  for (size_t i = 0; i < entries_.size(); i++) {
+    const Entry& entry{entries_[i]};
+    keys[i] = cache.Key({{GL_VERTEX_SHADER, CacheKeySource(entry.vertex_src)},
+                         {GL_FRAGMENT_SHADER,
+                          CacheKeySource(entry.fragment_src)}});
+    if (cache.Load(keys[i], *entry.program)) {
+      keys[i] = 0;
+      cached++;
     }
-    delete[] unif_indexes;
   }
-  std::cout << "------------------------------------------------\n";
-  delete[] name;
-  delete[] uni_name;
-#else
-  GLint num_blocks{0};
-
-  glGetProgramInterfaceiv(id_, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES,
-                          &num_blocks);
-  GLenum block_props[] = {GL_NUM_ACTIVE_VARIABLES, GL_NAME_LENGTH};
-  GLenum block_index[] = {GL_ACTIVE_VARIABLES};
-  GLenum props[] = {GL_NAME_LENGTH, GL_TYPE, GL_BLOCK_INDEX};
-
-  for (int block = 0; block < num_blocks; ++block) {
-    GLint block_info[2];
-    glGetProgramResourceiv(id_, GL_UNIFORM_BLOCK, block, 2, block_props, 2,
-                           NULL, block_info);
-    GLint num_unis = block_info[0];
-
-    char* block_name = new char[block_info[1] + 1];
-    glGetProgramResourceName(id_, GL_UNIFORM_BLOCK, block, block_info[1] + 1,
-                             NULL, block_name);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-    printf("Uniform block \"%s\":\n", block_name);
-    delete[] block_name;
-
-    GLint* unif_indexes = new GLint[num_unis];
-    glGetProgramResourceiv(id_, GL_UNIFORM_BLOCK, block, 1, block_index,
-                           num_unis, NULL, unif_indexes);
-
-    for (int unif = 0; unif < num_unis; ++unif) {
-      GLint uni_index = unif_indexes[unif];
-      GLint results[3];
-      glGetProgramResourceiv(id_, GL_UNIFORM, uni_index, 3, props, 3, NULL,
-                             results);
-
-      GLint name_buf_size = results[0] + 1;
-      char* name = new char[name_buf_size];
-      glGetProgramResourceName(id_, GL_UNIFORM, uni_index, name_buf_size, NULL,
-                               name);
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-      printf("    %s (%s)\n", name, GetTypeString(results[1]));
-      delete[] name;
+  // Submit every compile before the first link so that no link waits for
+  // a stage queued behind it.
+  ShaderLibrary& library{ShaderLibrary::Instance()};
+  std::vector<std::shared_ptr<Shader>> stages;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (keys[i] == 0) {
+      continue;
     }
-
-    delete[] unif_indexes;
+    const Entry& entry{entries_[i]};
+    stages.push_back(
+        library.Stage(VERTEXSHADER, entry.vertex_path, entry.vertex_src));
+    stages.push_back(
+        library.Stage(FRAGMENTSHADER, entry.fragment_path, entry.fragment_src));
   }
-#endif
+  auto stage{stages.begin()};
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (keys[i] == 0) {
+      continue;
+    }
+    GLSLProgram& program{*entries_[i].program};
+    program.Attach(std::move(*stage++));
+    program.Attach(std::move(*stage++));
+    program.SetBinaryRetrievable();
+    program.LinkDeferred(keys[i]);
+  }
+  ShaderReloader& reloader{ShaderReloader::Instance()};
+  if (reloader.IsEnabled()) {
+    for (const Entry& entry : entries_) {
+      std::vector<std::string> files{entry.vertex_src.files};
+      files.insert(files.end(), entry.fragment_src.files.begin(),
+                   entry.fragment_src.files.end());
+      reloader.Watch(*entry.program,
+                     {{VERTEXSHADER, entry.vertex_path},
+                      {FRAGMENTSHADER, entry.fragment_path}},
+                     entry.defines, files);
+    }
+  }
+  return cached;
 }
 
-void GLSLProgram::PrintActiveAttribs() const {
-#ifdef __APPLE__
-  // For OpenGL 4.1, use glGetActiveAttrib
-  GLint written{0};
-  GLint size{0};
-  GLint location{0};
-  GLint max_length{0};
-  GLint n_attribs{0};
-  GLenum type{0};
-  GLchar* name{nullptr};
-
-  glGetProgramiv(id_, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
-  glGetProgramiv(id_, GL_ACTIVE_ATTRIBUTES, &n_attribs);
-
-  name = new GLchar[max_length];
-  std::cout << "Active Attributes: \n";
-  std::cout << "------------------------------------------------\n";
-  for (int i = 0; i < n_attribs; i++) {
-    glGetActiveAttrib(id_, i, max_length, &written, &size, &type, name);
-    location = glGetAttribLocation(id_, name);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-    printf(" %-5d %s (%s)\n", location, name, GetTypeString(type));
-  }
-  std::cout << "------------------------------------------------\n";
-  delete[] name;
-#else
-  // >= OpenGL 4.3, use glGetProgramResource
-  GLint num_attribs{0};
-  glGetProgramInterfaceiv(id_, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES,
-                          &num_attribs);
-
-  GLenum properties[] = {GL_NAME_LENGTH, GL_TYPE, GL_LOCATION};
-
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-  printf("Active attributes:\n");
-  for (int i = 0; i < num_attribs; ++i) {
-    GLint results[3];
-    glGetProgramResourceiv(id_, GL_PROGRAM_INPUT, i, 3, properties, 3, NULL,
-                           results);
-
-    GLint name_buf_size = results[0] + 1;
-    char* name = new char[name_buf_size];
-    glGetProgramResourceName(id_, GL_PROGRAM_INPUT, i, name_buf_size, NULL,
-                             name);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
-    printf("%-5d %s (%s)\n", results[2], name, GetTypeString(results[1]));
-    delete[] name;
+size_t ShaderBatch::Pending() const {
+  return std::count_if(entries_.begin(), entries_.end(),
+                       [](const Entry& entry) {
+                         return not entry.program->IsLinkComplete();
+                       });
+}
+
+void ShaderBatch::Finish() noexcept(false) {
+  for (const Entry& entry : entries_) {
+    entry.program->CheckLinkStatus();
   }
-#endif
 }
 
 bool LoadShaderProgram(GLSLProgram& shader_program,
                        const std::string& vertex_shader_source_path,
-                       const std::string& fragement_shader_source_path) {
+                       const std::string& fragement_shader_source_path,
+                       const std::vector<std::string>& defines,
+                       SpirvUse spirv) {
   bool rv = true;
-  VertexShader vertex_shader(vertex_shader_source_path);
-  FragmentShader fragment_shader(fragement_shader_source_path);
-  shader_program.Attach(vertex_shader);
-  shader_program.Attach(fragment_shader);
-  shader_program.Link();
+  ShaderBatch batch;
+  batch.Add(shader_program, vertex_shader_source_path,
+            fragement_shader_source_path, defines, spirv);
+  if (batch.Submit() > 0) {
+    std::cout << "Shader program for " << vertex_shader_source_path << " and "
+              << fragement_shader_source_path
+              << " loaded from the program binary cache.\n";
+  } else {
+    std::cout << "Shader program built from " << vertex_shader_source_path
+              << " and " << fragement_shader_source_path << ".\n";
+  }
+  // Checks the compile and link status.
   shader_program.Activate();
 
-  std::cout << "Shader program built from " << vertex_shader_source_path
-            << " and " << fragement_shader_source_path << ".\n";
-
   if (shader_program.IsActive()) {
     std::cout << "Shader program is loaded and active with id "
               << shader_program.Id() << ".\n";
@@ -477,4 +641,4 @@ bool LoadShaderProgram(GLSLProgram& shader_program,
     rv = false;
   }
   return rv;
-}
\ No newline at end of file
+}
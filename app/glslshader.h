@@ -4,17 +4,25 @@
 #ifndef GLSLSHADER_H_
 #define GLSLSHADER_H_
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "glad/gl.h"
 #include "msutil.h"
+#include "programreflection.h"
 
 // #define NOTEXTURE
 // #ifndef NOTEXTURE
@@ -37,43 +45,138 @@ typedef enum {
 
 std::string ShaderTypeToString(shader_t shader_type);
 
+// The GLSL name of a uniform or attribute type, such as "vec3".
+const char* GetTypeString(GLenum type);
+
+// Throws GLSLException if the file cannot be read.
+std::string ReadShaderSource(const std::string& src_file_path);
+
+// A SPIR-V specialization constant: its SpecId and the 32 bits of its
+// value.
+struct SpecializationConstant {
+  GLuint id;
+  GLuint value;
+};
+
+// A stage's source after preprocessing, or its SPIR-V.
+struct ShaderSource {
+  // GLSL text, or the SPIR-V binary when spirv is true.
+  std::string text;
+  // The file and every file it includes. Compiler messages name a file by
+  // its index here, since #line cannot name files.
+  std::vector<std::string> files;
+  bool spirv{false};
+  std::vector<SpecializationConstant> constants;
+};
+
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
 class Shader {
  private:
   std::string src_file_path_;
   shader_t shader_type_;
   GLuint id_;
+  // GLSL source, or the SPIR-V binary when spirv_ is set.
   std::string src_;
+  bool spirv_{false};
+  std::vector<SpecializationConstant> constants_;
 
  public:
   Shader(const std::string& src_file_path, shader_t shader_type);
 
+  // Compiles src, which was already read from src_file_path. Without
+  // check_status the compile is only submitted; call CheckCompileStatus
+  // before relying on it.
+  Shader(const std::string& src_file_path, shader_t shader_type,
+         const std::string& src, bool check_status = true);
+
+  // Loads a SPIR-V binary and specializes its main function with
+  // constants. Needs OpenGL 4.6 or ARB_gl_spirv.
+  Shader(const std::string& src_file_path, shader_t shader_type,
+         const std::string& spirv,
+         const std::vector<SpecializationConstant>& constants,
+         bool check_status = true);
+
   ~Shader() {
     glDeleteShader(id_);
     ms_util::GLErrorCheck();
   }
 
-  std::string SrcFilePath() { return src_file_path_; }
+  std::string SrcFilePath() const { return src_file_path_; }
 
-  shader_t ShaderType() { return shader_type_; }
+  shader_t ShaderType() const { return shader_type_; }
 
   GLuint Id() const { return id_; }
 
   std::string Src() { return src_; }
 
+  bool Spirv() const { return spirv_; }
+
   bool CompileShader();
+
+  // Compiles the GLSL source, or reloads and re-specializes the SPIR-V.
+  void SubmitCompile();
+
+  // Waits for the compile if it is still running.
+  bool CheckCompileStatus() noexcept(false);
 };
 
 class VertexShader : public Shader {
  public:
   explicit VertexShader(const std::string& src_file_path)
       : Shader(src_file_path, VERTEXSHADER) {}
+
+  VertexShader(const std::string& src_file_path, const std::string& src)
+      : Shader(src_file_path, VERTEXSHADER, src) {}
 };
 
 class FragmentShader : public Shader {
  public:
   explicit FragmentShader(const std::string& src_file_path)
       : Shader(src_file_path, FRAGMENTSHADER) {}
+
+  FragmentShader(const std::string& src_file_path, const std::string& src)
+      : Shader(src_file_path, FRAGMENTSHADER, src) {}
+};
+
+// A uniform's name and its hash. Constructing one from a string literal
+// hashes it at compile time, so looking a uniform up by name costs a
+// binary search over integers.
+struct UniformName {
+  // NOLINTNEXTLINE(google-explicit-constructor,hicpp-explicit-conversions)
+  consteval UniformName(const char* name)
+      : name{name}, hash{ms_util::Fnv1a64(name)} {}
+
+  std::string_view name;
+  uint64_t hash;
+};
+
+class GLSLProgram;
+
+// A uniform resolved to its location once. Set writes the value with
+// GLSLProgram::WriteUniform: no string, no allocation and no search. If a
+// hot reload swaps the program, the location is resolved again on the next
+// Set.
+template <typename T>
+class Uniform {
+ public:
+  Uniform() = default;
+
+  Uniform(GLSLProgram& program, UniformName name);
+
+  GLint Location() const { return location_; }
+
+  // False when the program has no active uniform by this name.
+  bool IsValid() const { return location_ >= 0; }
+
+  void Set(const T& value);
+
+ private:
+  void Resolve();
+
+  GLSLProgram* program_{nullptr};
+  uint64_t hash_{0};
+  unsigned int generation_{0};
+  GLint location_{-1};
 };
 
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
@@ -81,10 +184,37 @@ class GLSLProgram {
  private:
   GLuint id_;
   bool linked_;
-  std::map<std::string, GLint> uniform_locations_;
+  ProgramReflection reflection_;
+  // Where the value last written to a location is kept in shadow_, indexed
+  // by location. A size of 0 means the value is not known: it may have an
+  // initializer in the shader.
+  struct ShadowSlot {
+    uint32_t offset{0};
+    uint32_t size{0};
+  };
+  std::vector<ShadowSlot> shadow_slots_;
+  std::vector<std::byte> shadow_;
+  // Set by BindUniformBlock; kept across Swap.
+  std::vector<std::pair<std::string, GLuint>> block_bindings_;
+  // Stages handed over with Attach(std::shared_ptr<Shader>).
+  std::vector<std::shared_ptr<Shader>> stages_;
+  unsigned int generation_{0};
+  bool link_pending_{false};
+  uint64_t cache_key_{0};
+  std::chrono::steady_clock::time_point link_submitted_;
 
   // Texture2D *_texture;
 
+  // Sizes the shadow for the reflected uniforms and forgets their values.
+  void ResetUniformShadow();
+
+  // Returns false, and counts a skipped write, if location already holds
+  // the size bytes at value; otherwise copies them and counts an upload.
+  bool ShadowUniform(GLint location, const void* value, size_t size);
+
+  template <typename T>
+  static void ProgramUniform(GLuint program, GLint location, const T& value);
+
  public:
   GLSLProgram();
 
@@ -102,6 +232,25 @@ class GLSLProgram {
     return (!ms_util::GLErrorCheck());
   }
 
+  // Attaches the stage and keeps it for as long as the program lives.
+  // Programs may share stages.
+  void Attach(std::shared_ptr<Shader> stage);
+
+  const std::vector<std::shared_ptr<Shader>>& Stages() const {
+    return stages_;
+  }
+
+  // Changes when Swap puts another program object behind this GLSLProgram
+  // and when the uniform locations are found after a link. Code that keeps
+  // Id() or a location, such as a recorded CommandBuffer or a Uniform,
+  // looks them up again when it changes.
+  unsigned int Generation() const { return generation_; }
+
+  // Exchanges program objects and stages with other, which is usually a
+  // rebuilt copy of this program. Call between frames on the thread that
+  // draws.
+  void Swap(GLSLProgram& other);
+
   bool DetachAll() const;
 
   bool Detach(GLuint shader_id) const {
@@ -121,6 +270,35 @@ class GLSLProgram {
 
   void Link() noexcept(false);
 
+  // Starts linking without waiting for the driver. The stages' compile
+  // status and the link status are checked by the first Activate or by
+  // CheckLinkStatus. A nonzero cache_key stores the linked program in the
+  // ProgramBinaryCache under that key.
+  void LinkDeferred(uint64_t cache_key = 0);
+
+  bool IsLinkPending() const { return link_pending_; }
+
+  // True when checking the status will not block. Without
+  // KHR_parallel_shader_compile there is no way to tell, so it is always
+  // true.
+  bool IsLinkComplete() const;
+
+  // Throws GLSLException if a stage or the link failed.
+  void CheckLinkStatus() noexcept(false);
+
+  // Call before Link so that GetBinary can retrieve the linked program.
+  void SetBinaryRetrievable() const {
+    glProgramParameteri(id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  // Loads a binary from GetBinary in place of linking. Returns false when
+  // the driver rejects it; the program can then be linked from source.
+  // Without a reflection saved with the binary, the program is queried.
+  bool LoadBinary(GLenum format, const void* binary, GLsizei length,
+                  const ProgramReflection* reflection = nullptr);
+
+  bool GetBinary(GLenum& format, std::vector<char>& binary) const;
+
   virtual bool ActivateUniforms() { return false; }
 
   bool Activate();
@@ -133,10 +311,31 @@ class GLSLProgram {
 
   bool IsActive() const;
 
+  // Takes the reflection snapshot; called after a successful link.
   void FindUniformLocations();
 
+  const ProgramReflection& Reflection() const { return reflection_; }
+
   int GetUniformLocation(const char* name);
 
+  // -1 when there is no active uniform with that name.
+  GLint UniformLocation(UniformName name) const {
+    return UniformLocation(name.hash);
+  }
+
+  GLint UniformLocation(uint64_t name_hash) const;
+
+  template <typename T>
+  Uniform<T> GetUniform(UniformName name) {
+    return Uniform<T>{*this, name};
+  }
+
+  // Writes value to the uniform at location with glProgramUniform, so the
+  // program need not be active, unless the location already holds the
+  // same bytes. GLStateCache counts the uploads and the skipped writes.
+  template <typename T>
+  void WriteUniform(GLint location, const T& value);
+
   void SetUniform(const char* name, float scalar);
 
   void SetUniform(const char* name, const glm::vec3& vec);
@@ -151,11 +350,135 @@ class GLSLProgram {
 
   void PrintActiveUniformBlocks() const;
 
+  // Connects the uniform block to a uniform buffer binding point; the GLSL
+  // 4.1 shaders cannot say so with layout(binding). Returns false if the
+  // program has no active block by that name.
+  bool BindUniformBlock(const char* block, GLuint binding);
+
   void PrintActiveAttribs() const;
 };
 
+template <typename T>
+void GLSLProgram::WriteUniform(GLint location, const T& value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (location >= 0 and ShadowUniform(location, &value, sizeof(T))) {
+    ProgramUniform(id_, location, value);
+  }
+}
+
+template <typename T>
+void GLSLProgram::ProgramUniform(GLuint program, GLint location,
+                                 const T& value) {
+  if constexpr (std::is_same_v<T, float>) {
+    glProgramUniform1f(program, location, value);
+  } else if constexpr (std::is_same_v<T, int>) {
+    glProgramUniform1i(program, location, value);
+  } else if constexpr (std::is_same_v<T, unsigned int>) {
+    glProgramUniform1ui(program, location, value);
+  } else if constexpr (std::is_same_v<T, glm::vec2>) {
+    glProgramUniform2fv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::vec3>) {
+    glProgramUniform3fv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::vec4>) {
+    glProgramUniform4fv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::ivec2>) {
+    glProgramUniform2iv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::ivec3>) {
+    glProgramUniform3iv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::ivec4>) {
+    glProgramUniform4iv(program, location, 1, glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::mat3>) {
+    glProgramUniformMatrix3fv(program, location, 1, GL_FALSE,
+                              glm::value_ptr(value));
+  } else if constexpr (std::is_same_v<T, glm::mat4>) {
+    glProgramUniformMatrix4fv(program, location, 1, GL_FALSE,
+                              glm::value_ptr(value));
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported uniform type.");
+  }
+}
+
+template <typename T>
+Uniform<T>::Uniform(GLSLProgram& program, UniformName name)
+    : program_{&program}, hash_{name.hash} {
+  Resolve();
+}
+
+template <typename T>
+void Uniform<T>::Resolve() {
+  generation_ = program_->Generation();
+  location_ = program_->UniformLocation(hash_);
+}
+
+template <typename T>
+void Uniform<T>::Set(const T& value) {
+  if (program_ == nullptr) {
+    return;
+  }
+  if (program_->Generation() != generation_) {
+    Resolve();
+  }
+  program_->WriteUniform(location_, value);
+}
+
+// Whether a program may be built from the SPIR-V that `make spirv` made
+// from its sources. OpenGL reports no names for the uniforms, blocks and
+// attributes of a program built from SPIR-V, so GetUniform, SetUniform,
+// BindUniformBlock and the block validations find nothing in it. Allow it
+// only for programs that use explicit locations and bindings and are
+// never looked up by name.
+enum class SpirvUse {
+  kNever,
+  // When the context supports SPIR-V and both stages have an up to date
+  // binary.
+  kIfBuilt,
+};
+
+// Builds many programs at once. Submit hands every compile to the driver,
+// then every link, and waits for none of them, so a driver with
+// KHR_parallel_shader_compile spreads the work over its compiler threads
+// while the program does something else. Each program's status is checked
+// when it is first activated, or for all of them by Finish. Programs found
+// in the ProgramBinaryCache are loaded instead of compiled. Stages come
+// from the ShaderLibrary, so programs that share a stage compile it once.
+class ShaderBatch {
+ public:
+  // Reads and preprocesses the sources with defines (see
+  // ShaderLibrary::Load); nothing is compiled until Submit. The program
+  // must outlive the batch.
+  void Add(GLSLProgram& program, const std::string& vertex_shader_source_path,
+           const std::string& fragment_shader_source_path,
+           const std::vector<std::string>& defines = {},
+           SpirvUse spirv = SpirvUse::kNever);
+
+  // Returns how many programs were loaded from the program binary cache.
+  size_t Submit() noexcept(false);
+
+  // Programs the driver is still compiling or linking.
+  size_t Pending() const;
+
+  // Checks every program and throws GLSLException for the first failure.
+  void Finish() noexcept(false);
+
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    GLSLProgram* program;
+    std::string vertex_path;
+    std::string fragment_path;
+    std::vector<std::string> defines;
+    ShaderSource vertex_src;
+    ShaderSource fragment_src;
+  };
+
+  std::vector<Entry> entries_;
+};
+
 bool LoadShaderProgram(GLSLProgram& shader_program,
                        const std::string& vertex_shader_source_path,
-                       const std::string& fragement_shader_source_path);
+                       const std::string& fragement_shader_source_path,
+                       const std::vector<std::string>& defines = {},
+                       SpirvUse spirv = SpirvUse::kNever);
 
 #endif
@@ -0,0 +1,313 @@
+
+#include "glstate.h"
+
+namespace {
+
+constexpr size_t kNotTracked{~size_t{0}};
+
+size_t BufferTargetIndex(GLenum target) {
+  switch (target) {
+    case GL_ARRAY_BUFFER:
+      return 0;
+    case GL_ELEMENT_ARRAY_BUFFER:
+      return 1;
+    case GL_UNIFORM_BUFFER:
+      return 2;
+    case GL_SHADER_STORAGE_BUFFER:
+      return 3;
+    case GL_DRAW_INDIRECT_BUFFER:
+      return 4;
+    case GL_COPY_READ_BUFFER:
+      return 5;
+    case GL_COPY_WRITE_BUFFER:
+      return 6;
+    default:
+      return kNotTracked;
+  }
+}
+
+size_t TextureTargetIndex(GLenum target) {
+  switch (target) {
+    case GL_TEXTURE_2D:
+      return 0;
+    case GL_TEXTURE_CUBE_MAP:
+      return 1;
+    case GL_TEXTURE_2D_ARRAY:
+      return 2;
+    case GL_TEXTURE_3D:
+      return 3;
+    case GL_TEXTURE_BUFFER:
+      return 4;
+    default:
+      return kNotTracked;
+  }
+}
+
+size_t CapabilityIndex(GLenum capability) {
+  switch (capability) {
+    case GL_BLEND:
+      return 0;
+    case GL_DEPTH_TEST:
+      return 1;
+    case GL_CULL_FACE:
+      return 2;
+    case GL_SCISSOR_TEST:
+      return 3;
+    case GL_STENCIL_TEST:
+      return 4;
+    default:
+      return kNotTracked;
+  }
+}
+
+}  // namespace
+
+GLStateCache& GLStateCache::Current() {
+  thread_local GLStateCache cache;
+  return cache;
+}
+
+void GLStateCache::Invalidate() {
+  program_ = kUnknown;
+  vao_ = kUnknown;
+  buffers_.fill(kUnknown);
+  uniform_ranges_.fill(BufferRange{});
+  draw_framebuffer_ = kUnknown;
+  read_framebuffer_ = kUnknown;
+  active_texture_ = kUnknown;
+  for (auto& unit : textures_) {
+    unit.fill(kUnknown);
+  }
+  samplers_.fill(kUnknown);
+  capabilities_.fill(Tristate::kUnknown);
+  blend_func_ = glm::uvec2(kUnknown);
+  depth_func_ = kUnknown;
+  depth_mask_ = Tristate::kUnknown;
+  viewport_ = glm::ivec4(-1);
+}
+
+void GLStateCache::UseProgram(GLuint program) {
+  if (Issue(program != program_)) {
+    glUseProgram(program);
+    program_ = program;
+  }
+}
+
+GLuint GLStateCache::CurrentProgram() {
+  if (program_ == kUnknown) {
+    GLint program{0};
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    program_ = static_cast<GLuint>(program);
+  }
+  return program_;
+}
+
+void GLStateCache::BindVertexArray(GLuint vao) {
+  if (Issue(vao != vao_)) {
+    glBindVertexArray(vao);
+    vao_ = vao;
+    // The element array binding belongs to the vertex array.
+    buffers_[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+  }
+}
+
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer) {
+  const size_t index{BufferTargetIndex(target)};
+  if (index == kNotTracked) {
+    Issue(true);
+    glBindBuffer(target, buffer);
+  } else if (Issue(buffers_[index] != buffer)) {
+    glBindBuffer(target, buffer);
+    buffers_[index] = buffer;
+  }
+}
+
+void GLStateCache::BindBufferRange(GLenum target, GLuint index,
+                                   GLuint buffer, GLintptr offset,
+                                   GLsizeiptr size) {
+  const size_t target_index{BufferTargetIndex(target)};
+  if (target == GL_UNIFORM_BUFFER and index < kMaxUniformBufferBindings) {
+    BufferRange& bound{uniform_ranges_[index]};
+    if (not Issue(bound.buffer != buffer or bound.offset != offset or
+                  bound.size != size)) {
+      return;
+    }
+    bound = BufferRange{buffer, offset, size};
+  } else {
+    Issue(true);
+  }
+  glBindBufferRange(target, index, buffer, offset, size);
+  if (target_index != kNotTracked) {
+    buffers_[target_index] = buffer;
+  }
+}
+
+void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer) {
+  const bool draw{target == GL_FRAMEBUFFER or target == GL_DRAW_FRAMEBUFFER};
+  const bool read{target == GL_FRAMEBUFFER or target == GL_READ_FRAMEBUFFER};
+  if (Issue((draw and draw_framebuffer_ != framebuffer) or
+            (read and read_framebuffer_ != framebuffer))) {
+    glBindFramebuffer(target, framebuffer);
+    if (draw) {
+      draw_framebuffer_ = framebuffer;
+    }
+    if (read) {
+      read_framebuffer_ = framebuffer;
+    }
+  }
+}
+
+void GLStateCache::ActiveTexture(GLuint unit) {
+  if (Issue(unit != active_texture_)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_texture_ = unit;
+  }
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+  const size_t index{TextureTargetIndex(target)};
+  if (unit >= kMaxTextureUnits or index == kNotTracked) {
+    ActiveTexture(unit);
+    Issue(true);
+    glBindTexture(target, texture);
+  } else if (Issue(textures_[unit][index] != texture)) {
+    ActiveTexture(unit);
+    glBindTexture(target, texture);
+    textures_[unit][index] = texture;
+  }
+}
+
+void GLStateCache::BindSampler(GLuint unit, GLuint sampler) {
+  if (unit >= kMaxTextureUnits) {
+    Issue(true);
+    glBindSampler(unit, sampler);
+  } else if (Issue(samplers_[unit] != sampler)) {
+    glBindSampler(unit, sampler);
+    samplers_[unit] = sampler;
+  }
+}
+
+void GLStateCache::SetCapability(GLenum capability, bool enabled) {
+  const size_t index{CapabilityIndex(capability)};
+  const Tristate wanted{enabled ? Tristate::kTrue : Tristate::kFalse};
+  if (index != kNotTracked and not Issue(capabilities_[index] != wanted)) {
+    return;
+  }
+  if (index == kNotTracked) {
+    Issue(true);
+  } else {
+    capabilities_[index] = wanted;
+  }
+  if (enabled) {
+    glEnable(capability);
+  } else {
+    glDisable(capability);
+  }
+}
+
+void GLStateCache::BlendFunc(GLenum source_factor,
+                             GLenum destination_factor) {
+  const glm::uvec2 func{source_factor, destination_factor};
+  if (Issue(func != blend_func_)) {
+    glBlendFunc(source_factor, destination_factor);
+    blend_func_ = func;
+  }
+}
+
+void GLStateCache::DepthFunc(GLenum func) {
+  if (Issue(func != depth_func_)) {
+    glDepthFunc(func);
+    depth_func_ = func;
+  }
+}
+
+void GLStateCache::DepthMask(bool enabled) {
+  const Tristate wanted{enabled ? Tristate::kTrue : Tristate::kFalse};
+  if (Issue(wanted != depth_mask_)) {
+    glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    depth_mask_ = wanted;
+  }
+}
+
+void GLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  const glm::ivec4 viewport{x, y, width, height};
+  if (Issue(viewport != viewport_)) {
+    glViewport(x, y, width, height);
+    viewport_ = viewport;
+  }
+}
+
+void GLStateCache::ForgetProgram(GLuint program) {
+  // A deleted program stays in use while it is current, so the next
+  // UseProgram, even of 0, must reach GL.
+  if (program_ == program) {
+    program_ = kUnknown;
+  }
+}
+
+void GLStateCache::ForgetVertexArray(GLuint vao) {
+  if (vao_ == vao) {
+    vao_ = 0;
+    buffers_[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+  }
+}
+
+void GLStateCache::ForgetBuffer(GLuint buffer) {
+  for (GLuint& binding : buffers_) {
+    if (binding == buffer) {
+      binding = 0;
+    }
+  }
+  for (BufferRange& range : uniform_ranges_) {
+    if (range.buffer == buffer) {
+      range = BufferRange{0, 0, 0};
+    }
+  }
+}
+
+void GLStateCache::ForgetTexture(GLuint texture) {
+  for (auto& unit : textures_) {
+    for (GLuint& binding : unit) {
+      if (binding == texture) {
+        binding = 0;
+      }
+    }
+  }
+}
+
+void GLStateCache::ForgetFramebuffer(GLuint framebuffer) {
+  if (draw_framebuffer_ == framebuffer) {
+    draw_framebuffer_ = 0;
+  }
+  if (read_framebuffer_ == framebuffer) {
+    read_framebuffer_ = 0;
+  }
+}
+
+void GLStateCache::EndFrame() {
+  total_.issued += frame_.issued;
+  total_.filtered += frame_.filtered;
+  frame_ = GLStateCounters{};
+  uniform_total_.issued += uniform_frame_.issued;
+  uniform_total_.filtered += uniform_frame_.filtered;
+  uniform_frame_ = GLStateCounters{};
+  frames_++;
+}
+
+std::ostream& operator<<(std::ostream& out, const GLStateCache& cache) {
+  const GLStateCounters& total{cache.TotalCounters()};
+  out << "GL state cache: " << total.issued << " calls issued, "
+      << total.filtered << " redundant calls skipped";
+  if (cache.Frames() > 0) {
+    out << " (" << (total.filtered / cache.Frames()) << " per frame)";
+  }
+  const GLStateCounters& uniforms{cache.TotalUniformCounters()};
+  out << "\nUniforms: " << uniforms.issued << " uploaded, "
+      << uniforms.filtered << " unchanged writes skipped";
+  if (cache.Frames() > 0) {
+    out << " (" << (uniforms.issued / cache.Frames()) << " and "
+        << (uniforms.filtered / cache.Frames()) << " per frame)";
+  }
+  out << "\n";
+  return out;
+}
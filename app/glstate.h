@@ -0,0 +1,159 @@
+#ifndef GLSTATE_H_
+#define GLSTATE_H_
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <iostream>
+
+#include "glad/gl.h"
+
+struct GLStateCounters {
+  // GL calls made on behalf of callers.
+  unsigned long issued{0};
+  // Calls that were dropped because the state already had that value.
+  unsigned long filtered{0};
+};
+
+// A shadow copy of the GL state that the framework changes: the current
+// program, vertex array, buffer, framebuffer, texture and sampler bindings,
+// blend, depth, cull, scissor and stencil state, and the viewport. Setting a
+// value the context already has costs a comparison instead of a GL call,
+// and queries are answered without a glGet round trip to the driver.
+//
+// Each thread has its own cache because a context is current on at most one
+// thread. Call Invalidate after making a context current on a thread that
+// has used another one, and after GL calls that bypass the cache.
+class GLStateCache {
+ public:
+  static constexpr GLuint kUnknown{0xFFFFFFFF};
+  static constexpr size_t kMaxTextureUnits{32};
+  // The minimum GL_MAX_UNIFORM_BUFFER_BINDINGS in OpenGL 4.1.
+  static constexpr size_t kMaxUniformBufferBindings{36};
+
+  static GLStateCache& Current();
+
+  void Invalidate();
+
+  void UseProgram(GLuint program);
+
+  // Queries the context only when the binding is not known.
+  GLuint CurrentProgram();
+
+  void BindVertexArray(GLuint vao);
+
+  void BindBuffer(GLenum target, GLuint buffer);
+
+  // Binds a range of buffer to an indexed binding point. Like
+  // glBindBufferRange, it binds buffer to target as well.
+  void BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                       GLintptr offset, GLsizeiptr size);
+
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+  void ActiveTexture(GLuint unit);
+
+  void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+  void BindSampler(GLuint unit, GLuint sampler);
+
+  void Enable(GLenum capability) { SetCapability(capability, true); }
+
+  void Disable(GLenum capability) { SetCapability(capability, false); }
+
+  void SetCapability(GLenum capability, bool enabled);
+
+  void BlendFunc(GLenum source_factor, GLenum destination_factor);
+
+  void DepthFunc(GLenum func);
+
+  void DepthMask(bool enabled);
+
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // Deleting a bound object resets its binding to zero, except for the
+  // current program, which GL keeps using; its binding becomes unknown.
+  void ForgetProgram(GLuint program);
+  void ForgetVertexArray(GLuint vao);
+  void ForgetBuffer(GLuint buffer);
+  void ForgetTexture(GLuint texture);
+  void ForgetFramebuffer(GLuint framebuffer);
+
+  // Counts a GLSLProgram::WriteUniform: an upload, or a write skipped
+  // because the uniform already held the value.
+  void CountUniformWrite(bool uploaded) {
+    if (uploaded) {
+      uniform_frame_.issued++;
+    } else {
+      uniform_frame_.filtered++;
+    }
+  }
+
+  // Closes the current frame's counters and adds them to the totals.
+  void EndFrame();
+
+  const GLStateCounters& FrameCounters() const { return frame_; }
+
+  const GLStateCounters& TotalCounters() const { return total_; }
+
+  // Uniform uploads are counted as issued, skipped writes as filtered.
+  const GLStateCounters& FrameUniformCounters() const {
+    return uniform_frame_;
+  }
+
+  const GLStateCounters& TotalUniformCounters() const {
+    return uniform_total_;
+  }
+
+  unsigned long Frames() const { return frames_; }
+
+ private:
+  GLStateCache() { Invalidate(); }
+
+  enum class Tristate : int8_t { kUnknown = -1, kFalse = 0, kTrue = 1 };
+
+  struct BufferRange {
+    GLuint buffer{kUnknown};
+    GLintptr offset{0};
+    GLsizeiptr size{0};
+  };
+
+  static constexpr size_t kNumBufferTargets{7};
+  static constexpr size_t kNumTextureTargets{5};
+  static constexpr size_t kNumCapabilities{5};
+
+  bool Issue(bool changed) {
+    if (changed) {
+      frame_.issued++;
+    } else {
+      frame_.filtered++;
+    }
+    return changed;
+  }
+
+  GLuint program_{kUnknown};
+  GLuint vao_{kUnknown};
+  std::array<GLuint, kNumBufferTargets> buffers_{};
+  std::array<BufferRange, kMaxUniformBufferBindings> uniform_ranges_{};
+  GLuint draw_framebuffer_{kUnknown};
+  GLuint read_framebuffer_{kUnknown};
+  GLuint active_texture_{kUnknown};
+  std::array<std::array<GLuint, kNumTextureTargets>, kMaxTextureUnits>
+      textures_{};
+  std::array<GLuint, kMaxTextureUnits> samplers_{};
+  std::array<Tristate, kNumCapabilities> capabilities_{};
+  glm::uvec2 blend_func_{kUnknown};
+  GLenum depth_func_{kUnknown};
+  Tristate depth_mask_{Tristate::kUnknown};
+  glm::ivec4 viewport_{-1};
+
+  GLStateCounters frame_;
+  GLStateCounters total_;
+  GLStateCounters uniform_frame_;
+  GLStateCounters uniform_total_;
+  unsigned long frames_{0};
+};
+
+std::ostream& operator<<(std::ostream& out, const GLStateCache& cache);
+
+#endif
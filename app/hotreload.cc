@@ -0,0 +1,293 @@
+
+#include "hotreload.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+#include "shaderlibrary.h"
+
+#ifdef LINUX
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// How long the watcher waits before checking whether it should stop.
+constexpr int kWatchPeriodMs{250};
+
+}  // namespace
+
+FileWatcher::FileWatcher() {
+#ifdef LINUX
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    std::cerr << "FileWatcher: inotify is not available.\n";
+  }
+#endif
+  thread_ = std::thread{&FileWatcher::WatchLoop, this};
+}
+
+FileWatcher::~FileWatcher() {
+  stop_ = true;
+  thread_.join();
+#ifdef LINUX
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+#endif
+}
+
+std::string FileWatcher::Normalize(const std::string& path) {
+  std::error_code error;
+  const std::filesystem::path absolute{std::filesystem::absolute(path, error)};
+  return (error ? std::filesystem::path{path} : absolute)
+      .lexically_normal()
+      .string();
+}
+
+void FileWatcher::Add(const std::string& path) {
+  const std::string normalized{Normalize(path)};
+  const std::lock_guard<std::mutex> lock{mutex_};
+  if (not paths_.insert(normalized).second) {
+    return;
+  }
+#ifdef LINUX
+  if (inotify_fd_ < 0) {
+    return;
+  }
+  const std::string directory{
+      std::filesystem::path{normalized}.parent_path().string()};
+  // Watching the directory catches saves that replace the file.
+  const int wd{inotify_add_watch(inotify_fd_, directory.c_str(),
+                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)};
+  if (wd >= 0) {
+    directories_[wd] = directory;
+  }
+#else
+  std::error_code error;
+  write_times_[normalized] =
+      std::filesystem::last_write_time(normalized, error);
+#endif
+}
+
+std::set<std::string> FileWatcher::TakeChanged() {
+  std::set<std::string> changed;
+  const std::lock_guard<std::mutex> lock{mutex_};
+  changed.swap(changed_);
+  return changed;
+}
+
+void FileWatcher::WatchLoop() {
+#ifdef LINUX
+  // Large enough for many events with file names.
+  alignas(inotify_event) std::array<char, 4096> buffer{};
+  while (not stop_) {
+    if (inotify_fd_ < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{kWatchPeriodMs});
+      continue;
+    }
+    pollfd fd{inotify_fd_, POLLIN, 0};
+    if (poll(&fd, 1, kWatchPeriodMs) <= 0) {
+      continue;
+    }
+    ssize_t length{0};
+    while ((length = read(inotify_fd_, buffer.data(), buffer.size())) > 0) {
+      const std::lock_guard<std::mutex> lock{mutex_};
+      for (ssize_t at = 0; at < length;) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        const auto* event{reinterpret_cast<const inotify_event*>(&buffer[at])};
+        const auto directory{directories_.find(event->wd)};
+        if (event->len > 0 and directory != directories_.end()) {
+          const std::string path{directory->second + "/" + event->name};
+          if (paths_.count(path) > 0) {
+            changed_.insert(path);
+          }
+        }
+        at += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+      }
+    }
+  }
+#else
+  while (not stop_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{kWatchPeriodMs});
+    const std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& [path, write_time] : write_times_) {
+      std::error_code error;
+      const auto now{std::filesystem::last_write_time(path, error)};
+      if (not error and now != write_time) {
+        write_time = now;
+        changed_.insert(path);
+      }
+    }
+  }
+#endif
+}
+
+ShaderReloader& ShaderReloader::Instance() {
+  // Never destroyed: GLSLProgram destructors unwatch themselves, and some
+  // run during static destruction.
+  static auto* reloader{new ShaderReloader};
+  return *reloader;
+}
+
+void ShaderReloader::Enable() {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  if (not watcher_) {
+    watcher_ = std::make_unique<FileWatcher>();
+  }
+  enabled_ = true;
+}
+
+void ShaderReloader::Disable() {
+  std::vector<Rebuild> abandoned;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    enabled_ = false;
+    watcher_.reset();
+    watched_.clear();
+    abandoned.swap(rebuilds_);
+  }
+}
+
+void ShaderReloader::Watch(GLSLProgram& program,
+                           const std::vector<StageSource>& stages,
+                           const std::vector<std::string>& defines,
+                           const std::vector<std::string>& files) {
+  if (not enabled_) {
+    return;
+  }
+  const std::lock_guard<std::mutex> lock{mutex_};
+  if (not watcher_) {
+    return;
+  }
+  Watched entry{&program, stages, defines, {}};
+  for (const std::string& file : files) {
+    entry.files.insert(FileWatcher::Normalize(file));
+    watcher_->Add(file);
+  }
+  auto found{std::find_if(
+      watched_.begin(), watched_.end(),
+      [&](const Watched& watched) { return watched.program == &program; })};
+  if (found == watched_.end()) {
+    watched_.push_back(std::move(entry));
+  } else {
+    *found = std::move(entry);
+  }
+}
+
+void ShaderReloader::Unwatch(const GLSLProgram& program) {
+  if (not enabled_) {
+    return;
+  }
+  std::vector<Rebuild> abandoned;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    std::erase_if(watched_, [&](const Watched& watched) {
+      return watched.program == &program;
+    });
+    for (auto it = rebuilds_.begin(); it != rebuilds_.end();) {
+      if (it->target == &program) {
+        abandoned.push_back(std::move(*it));
+        it = rebuilds_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  // The replacements are destroyed here, outside the lock, since their
+  // destructors unwatch too.
+}
+
+unsigned int ShaderReloader::Update() {
+  if (not enabled_) {
+    return 0;
+  }
+  // Finished and abandoned rebuilds are destroyed after the lock is
+  // released, since GLSLProgram's destructor unwatches.
+  std::vector<Rebuild> finished;
+  unsigned int swapped{0};
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    if (not watcher_) {
+      return 0;
+    }
+    const std::set<std::string> changed{watcher_->TakeChanged()};
+    if (not changed.empty()) {
+      StartRebuilds(changed, finished);
+    }
+    for (auto it = rebuilds_.begin(); it != rebuilds_.end();) {
+      if (not it->replacement->IsLinkComplete()) {
+        ++it;
+        continue;
+      }
+      try {
+        it->replacement->CheckLinkStatus();
+        it->target->Swap(*it->replacement);
+        swapped++;
+        reloads_++;
+        std::cerr << "Hot reload: swapped in program " << it->target->Id()
+                  << ".\n";
+      } catch (const GLSLException& exception) {
+        failures_++;
+        std::cerr << "Hot reload: keeping program " << it->target->Id()
+                  << ".\n"
+                  << exception.what();
+      }
+      // After a swap, the replacement holds the old program object.
+      finished.push_back(std::move(*it));
+      it = rebuilds_.erase(it);
+    }
+  }
+  return swapped;
+}
+
+void ShaderReloader::StartRebuilds(const std::set<std::string>& changed,
+                                   std::vector<Rebuild>& abandoned) {
+  ShaderLibrary& library{ShaderLibrary::Instance()};
+  for (Watched& watched : watched_) {
+    const bool affected{std::any_of(
+        changed.begin(), changed.end(), [&](const std::string& path) {
+          return watched.files.count(path) > 0;
+        })};
+    if (not affected) {
+      continue;
+    }
+    // A newer edit replaces a rebuild that is still linking.
+    for (auto it = rebuilds_.begin(); it != rebuilds_.end();) {
+      if (it->target == watched.program) {
+        abandoned.push_back(std::move(*it));
+        it = rebuilds_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    std::unique_ptr<GLSLProgram> replacement;
+    try {
+      replacement = std::make_unique<GLSLProgram>();
+      // Stages whose source did not change are the running program's.
+      for (const auto& [type, path] : watched.stages) {
+        const ShaderSource source{library.Load(path, watched.defines)};
+        for (const std::string& file : source.files) {
+          // An edit may have included a new file.
+          if (watched.files.insert(file).second) {
+            watcher_->Add(file);
+          }
+        }
+        replacement->Attach(library.Stage(type, path, source));
+      }
+      replacement->LinkDeferred();
+      rebuilds_.push_back(Rebuild{watched.program, std::move(replacement)});
+      std::cerr << "Hot reload: rebuilding program " << watched.program->Id()
+                << ".\n";
+    } catch (const GLSLException& exception) {
+      failures_++;
+      std::cerr << "Hot reload: " << exception.what();
+      abandoned.push_back(Rebuild{watched.program, std::move(replacement)});
+    }
+  }
+}
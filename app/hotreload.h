@@ -0,0 +1,123 @@
+#ifndef HOTRELOAD_H_
+#define HOTRELOAD_H_
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "glslshader.h"
+
+// Watches files from a background thread and remembers which ones were
+// written. On Linux it uses inotify on the files' directories, so editors
+// that save by renaming a new file over the old one are noticed too;
+// elsewhere it polls modification times a few times a second.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class FileWatcher {
+ public:
+  FileWatcher();
+
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // Absolute and without . or .. so the same file always compares equal.
+  static std::string Normalize(const std::string& path);
+
+  void Add(const std::string& path);
+
+  // The normalized paths written since the last call.
+  std::set<std::string> TakeChanged();
+
+ private:
+  void WatchLoop();
+
+  std::mutex mutex_;
+  std::set<std::string> paths_;
+  std::set<std::string> changed_;
+#ifdef LINUX
+  int inotify_fd_{-1};
+  std::map<int, std::string> directories_;
+#else
+  std::map<std::string, std::filesystem::file_time_type> write_times_;
+#endif
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+// Rebuilds shader programs whose source files, or the files they include,
+// change while the program runs. Stages come from the ShaderLibrary, so
+// only the stages whose source changed are compiled again; the others are
+// shared with the running program. The rebuild is linked without
+// waiting (see GLSLProgram::LinkDeferred), and Update swaps it into the
+// GLSLProgram once it has linked. If a stage fails to compile or the
+// program fails to link, the error is printed and the old program keeps
+// running.
+class ShaderReloader {
+ public:
+  using StageSource = std::pair<shader_t, std::string>;
+
+  static ShaderReloader& Instance();
+
+  // Start watching. Programs built by LoadShaderProgram or a ShaderBatch
+  // afterward are watched.
+  void Enable();
+
+  // Stops the watcher thread; call before exiting.
+  void Disable();
+
+  bool IsEnabled() const { return enabled_; }
+
+  // Does nothing unless enabled. The stages are preprocessed with defines;
+  // files lists every file they read.
+  void Watch(GLSLProgram& program, const std::vector<StageSource>& stages,
+             const std::vector<std::string>& defines,
+             const std::vector<std::string>& files);
+
+  void Unwatch(const GLSLProgram& program);
+
+  // Call between frames on the thread that draws. Returns the number of
+  // programs swapped.
+  unsigned int Update();
+
+  unsigned long Reloads() const { return reloads_; }
+
+  unsigned long Failures() const { return failures_; }
+
+ private:
+  ShaderReloader() = default;
+
+  struct Watched {
+    GLSLProgram* program;
+    std::vector<StageSource> stages;
+    std::vector<std::string> defines;
+    // Normalized.
+    std::set<std::string> files;
+  };
+
+  struct Rebuild {
+    GLSLProgram* target;
+    std::unique_ptr<GLSLProgram> replacement;
+  };
+
+  // Rebuilds that are replaced go to abandoned.
+  void StartRebuilds(const std::set<std::string>& changed,
+                     std::vector<Rebuild>& abandoned);
+
+  std::atomic<bool> enabled_{false};
+  std::unique_ptr<FileWatcher> watcher_;
+  std::mutex mutex_;
+  std::vector<Watched> watched_;
+  std::vector<Rebuild> rebuilds_;
+  std::atomic<unsigned long> reloads_{0};
+  std::atomic<unsigned long> failures_{0};
+};
+
+#endif
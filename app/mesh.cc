@@ -0,0 +1,131 @@
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <sstream>
+
+void ValidateVertexLayout(const GLSLProgram& program,
+                          std::span<const VertexAttributeFormat> attributes,
+                          std::span<const std::string_view> names) {
+  const ProgramReflection& reflection{program.Reflection()};
+  std::stringstream errors;
+  for (const ReflectedAttribute& attribute : reflection.Attributes()) {
+    std::string_view name{reflection.Name(attribute.name)};
+    // Some drivers list gl_VertexID and gl_InstanceID.
+    if (name.starts_with("gl_")) {
+      continue;
+    }
+    size_t index{names.size()};
+    if (name.empty()) {
+      // A program built from SPIR-V has no names; its attributes are
+      // found by location instead.
+      const auto expected_location{std::find_if(
+          attributes.begin(), attributes.end(),
+          [&](const VertexAttributeFormat& expected) {
+            return static_cast<GLint>(expected.location) ==
+                   attribute.location;
+          })};
+      index = static_cast<size_t>(
+          std::distance(attributes.begin(), expected_location));
+      if (index == attributes.size()) {
+        errors << "  The attribute at location " << attribute.location
+               << " is not in the layout.\n";
+        continue;
+      }
+      name = names[index];
+    } else {
+      index = static_cast<size_t>(std::distance(
+          names.begin(), std::find(names.begin(), names.end(), name)));
+      if (index == names.size()) {
+        errors << "  " << name << " is not in the layout.\n";
+        continue;
+      }
+    }
+    const VertexAttributeFormat& expected{attributes[index]};
+    if (attribute.location != static_cast<GLint>(expected.location)) {
+      errors << "  " << name << " is at location " << attribute.location
+             << ", not " << expected.location << ".\n";
+    }
+    if (attribute.type != expected.glsl_type) {
+      errors << "  " << name << " is a " << GetTypeString(attribute.type)
+             << ", not a " << GetTypeString(expected.glsl_type) << ".\n";
+    }
+  }
+  if (not errors.str().empty()) {
+    throw MeshException("Program " + std::to_string(program.Id()) +
+                        " does not match its vertex layout:\n" +
+                        errors.str());
+  }
+}
+
+GPUBuffer::GPUBuffer() { glGenBuffers(1, &id_); }
+
+GPUBuffer::~GPUBuffer() {
+  GLStateCache::Current().ForgetBuffer(id_);
+  glDeleteBuffers(1, &id_);
+}
+
+void GPUBuffer::Allocate(size_t size, const void* data, GLenum usage) {
+  GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, id_);
+  glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(size), data,
+               usage);
+  size_ = size;
+}
+
+void GPUBuffer::Write(size_t offset, size_t size, const void* data) {
+  if (offset + size > size_) {
+    throw MeshException("Writing " + std::to_string(size) +
+                        " bytes at offset " + std::to_string(offset) +
+                        " overflows a buffer of " + std::to_string(size_) +
+                        " bytes.");
+  }
+  GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, id_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+                  static_cast<GLsizeiptr>(size), data);
+}
+
+GLuint MakeVertexArray(std::span<const VertexStream> streams,
+                       GLuint index_buffer) {
+  GLStateCache& state{GLStateCache::Current()};
+  GLuint vao{0};
+  glGenVertexArrays(1, &vao);
+  state.BindVertexArray(vao);
+  for (const VertexStream& stream : streams) {
+    state.BindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    for (const VertexAttributeFormat& attribute : stream.attributes) {
+      // A matrix is a vec4 attribute per column.
+      const size_t column_size{attribute.components * sizeof(float)};
+      for (GLuint column = 0; column < attribute.num_locations; column++) {
+        const GLuint location{stream.first_location + attribute.location +
+                              column};
+        // NOLINTNEXTLINE(performance-no-int-to-ptr)
+        const auto* offset{reinterpret_cast<const void*>(
+            attribute.offset + column * column_size)};
+        glEnableVertexAttribArray(location);
+        if (attribute.integer) {
+          glVertexAttribIPointer(location, attribute.components,
+                                 attribute.type, stream.stride, offset);
+        } else {
+          glVertexAttribPointer(location, attribute.components, attribute.type,
+                                attribute.normalized ? GL_TRUE : GL_FALSE,
+                                stream.stride, offset);
+        }
+        if (stream.divisor != 0) {
+          glVertexAttribDivisor(location, stream.divisor);
+        }
+      }
+    }
+  }
+  if (index_buffer != 0) {
+    state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+  }
+  return vao;
+}
+
+void DeleteVertexArray(GLuint vao) {
+  if (vao == 0) {
+    return;
+  }
+  GLStateCache::Current().ForgetVertexArray(vao);
+  glDeleteVertexArrays(1, &vao);
+}
@@ -0,0 +1,480 @@
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "commandbuffer.h"
+#include "glad/gl.h"
+#include "glslshader.h"
+#include "glstate.h"
+#include "msutil.h"
+
+class MeshException : public std::runtime_error {
+ public:
+  explicit MeshException(const std::string& message)
+      : std::runtime_error(message) {}
+};
+
+// How one member of a vertex is passed to glVertexAttribPointer and what
+// the program should declare for it.
+struct VertexAttributeFormat {
+  // The first of the attribute's locations; a matrix takes one per column.
+  GLuint location;
+  GLuint num_locations;
+  GLint components;
+  GLenum type;
+  bool normalized;
+  // Read with glVertexAttribIPointer, as an int or uint vector.
+  bool integer;
+  size_t offset;
+  // The type the program reports for the attribute.
+  GLenum glsl_type;
+};
+
+namespace vertex_format {
+
+// The attribute format of a C++ vertex member: a float, int32_t or
+// uint32_t, a glm vector of those, glm::u8vec4 for a normalized color, or
+// glm::mat4.
+template <typename T>
+struct Traits {
+  static_assert(sizeof(T) == 0, "Unsupported vertex member type.");
+};
+
+template <typename S>
+struct ScalarTraits;
+
+template <>
+struct ScalarTraits<float> {
+  static constexpr GLenum kType{GL_FLOAT};
+  static constexpr bool kInteger{false};
+  static constexpr std::array<GLenum, 4> kGLSLTypes{
+      GL_FLOAT, GL_FLOAT_VEC2, GL_FLOAT_VEC3, GL_FLOAT_VEC4};
+};
+
+template <>
+struct ScalarTraits<int32_t> {
+  static constexpr GLenum kType{GL_INT};
+  static constexpr bool kInteger{true};
+  static constexpr std::array<GLenum, 4> kGLSLTypes{GL_INT, GL_INT_VEC2,
+                                                    GL_INT_VEC3, GL_INT_VEC4};
+};
+
+template <>
+struct ScalarTraits<uint32_t> {
+  static constexpr GLenum kType{GL_UNSIGNED_INT};
+  static constexpr bool kInteger{true};
+  static constexpr std::array<GLenum, 4> kGLSLTypes{
+      GL_UNSIGNED_INT, GL_UNSIGNED_INT_VEC2, GL_UNSIGNED_INT_VEC3,
+      GL_UNSIGNED_INT_VEC4};
+};
+
+template <typename S, int kLength>
+struct VectorTraits {
+  static constexpr GLuint kNumLocations{1};
+  static constexpr GLint kComponents{kLength};
+  static constexpr GLenum kType{ScalarTraits<S>::kType};
+  static constexpr bool kNormalized{false};
+  static constexpr bool kInteger{ScalarTraits<S>::kInteger};
+  static constexpr GLenum kGLSLType{ScalarTraits<S>::kGLSLTypes[kLength - 1]};
+};
+
+template <>
+struct Traits<float> : VectorTraits<float, 1> {};
+
+template <>
+struct Traits<int32_t> : VectorTraits<int32_t, 1> {};
+
+template <>
+struct Traits<uint32_t> : VectorTraits<uint32_t, 1> {};
+
+template <int kLength, typename S, glm::qualifier Q>
+struct Traits<glm::vec<kLength, S, Q>> : VectorTraits<S, kLength> {};
+
+// Four bytes that the shader reads as a vec4 between 0 and 1.
+template <glm::qualifier Q>
+struct Traits<glm::vec<4, uint8_t, Q>> {
+  static constexpr GLuint kNumLocations{1};
+  static constexpr GLint kComponents{4};
+  static constexpr GLenum kType{GL_UNSIGNED_BYTE};
+  static constexpr bool kNormalized{true};
+  static constexpr bool kInteger{false};
+  static constexpr GLenum kGLSLType{GL_FLOAT_VEC4};
+};
+
+// One vec4 attribute per column.
+template <glm::qualifier Q>
+struct Traits<glm::mat<4, 4, float, Q>> : VectorTraits<float, 4> {
+  static constexpr GLuint kNumLocations{4};
+  static constexpr GLenum kGLSLType{GL_FLOAT_MAT4};
+};
+
+// Visits the members in order with the offset and first location of each,
+// and returns where the last one ends.
+template <typename... Members, typename Visit>
+constexpr size_t ForEachMember(Visit visit) {
+  size_t offset{0};
+  GLuint location{0};
+  const auto add{[&]<typename T>() {
+    offset = ms_util::RoundUp(offset, alignof(T));
+    visit.template operator()<T>(offset, location);
+    offset += sizeof(T);
+    location += Traits<T>::kNumLocations;
+  }};
+  (add.template operator()<Members>(), ...);
+  return offset;
+}
+
+template <typename... Members>
+constexpr std::array<VertexAttributeFormat, sizeof...(Members)> Attributes() {
+  std::array<VertexAttributeFormat, sizeof...(Members)> attributes{};
+  size_t i{0};
+  ForEachMember<Members...>([&]<typename T>(size_t offset, GLuint location) {
+    attributes[i++] = VertexAttributeFormat{
+        location,        Traits<T>::kNumLocations, Traits<T>::kComponents,
+        Traits<T>::kType, Traits<T>::kNormalized,  Traits<T>::kInteger,
+        offset,          Traits<T>::kGLSLType};
+  });
+  return attributes;
+}
+
+template <typename... Members>
+constexpr size_t Size() {
+  return ForEachMember<Members...>([]<typename T>(size_t, GLuint) {});
+}
+
+}  // namespace vertex_format
+
+// The vertex format of Vertex, a struct whose members have the types
+// Members in order, such as
+//
+//   struct Vertex {
+//     glm::vec3 position;
+//     glm::u8vec4 color;
+//   };
+//   using Layout = VertexLayout<Vertex, glm::vec3, glm::u8vec4>;
+//
+// The offsets follow the C++ rules for laying out a struct, and the
+// stride is sizeof(Vertex); a member list that does not add up to Vertex
+// does not compile. Member i is bound to the location after the ones
+// members 0 to i - 1 take, so the shader declares the attributes in the
+// same order with layout (location = N).
+template <typename V, typename... Members>
+struct VertexLayout {
+  using Vertex = V;
+
+  static_assert(std::is_standard_layout_v<Vertex> and
+                    std::is_trivially_copyable_v<Vertex>,
+                "A vertex must be a plain struct.");
+  static_assert(ms_util::RoundUp(vertex_format::Size<Members...>(),
+                                alignof(Vertex)) == sizeof(Vertex),
+                "The members do not make up the vertex.");
+
+  static constexpr size_t kNumAttributes{sizeof...(Members)};
+
+  static constexpr std::array<VertexAttributeFormat, kNumAttributes>
+      kAttributes{vertex_format::Attributes<Members...>()};
+
+  static constexpr GLsizei kStride{sizeof(Vertex)};
+
+  // The locations the attributes take, 0 to kNumLocations - 1.
+  static constexpr GLuint kNumLocations{kAttributes.back().location +
+                                        kAttributes.back().num_locations};
+};
+
+// Compares a layout with the attributes the linked program reports and
+// throws a MeshException listing every difference: an attribute at
+// another location or of another type, or an active attribute the layout
+// does not have. names are the attributes' names in the shader, in the
+// layout's order. A layout attribute that the program does not use is
+// not an error, since the compiler removes unused attributes. Attributes
+// without names, as in a program built from SPIR-V, are matched by
+// location, so only their types are checked.
+void ValidateVertexLayout(const GLSLProgram& program,
+                          std::span<const VertexAttributeFormat> attributes,
+                          std::span<const std::string_view> names);
+
+template <typename Layout>
+void ValidateVertexLayout(
+    const GLSLProgram& program,
+    const std::array<std::string_view, Layout::kNumAttributes>& names) {
+  ValidateVertexLayout(program, Layout::kAttributes, names);
+}
+
+// Validates a mesh's vertex layout together with the instance layout whose
+// attributes follow it (see Mesh::SetInstances).
+template <typename Layout, typename InstanceLayout>
+void ValidateVertexLayout(
+    const GLSLProgram& program,
+    const std::array<std::string_view, Layout::kNumAttributes>& names,
+    const std::array<std::string_view, InstanceLayout::kNumAttributes>&
+        instance_names) {
+  std::vector<VertexAttributeFormat> attributes(Layout::kAttributes.begin(),
+                                                Layout::kAttributes.end());
+  std::vector<std::string_view> all_names(names.begin(), names.end());
+  for (size_t i = 0; i < InstanceLayout::kNumAttributes; i++) {
+    VertexAttributeFormat attribute{InstanceLayout::kAttributes[i]};
+    attribute.location += Layout::kNumLocations;
+    attributes.push_back(attribute);
+    all_names.push_back(instance_names[i]);
+  }
+  ValidateVertexLayout(program, attributes, all_names);
+}
+
+// A buffer object of vertex or index data. Data is written through
+// GL_COPY_WRITE_BUFFER, so filling a buffer changes no vertex array's
+// element array binding, and a buffer may be filled on a loader thread
+// whose context shares objects with the drawing one.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class GPUBuffer {
+ public:
+  GPUBuffer();
+
+  ~GPUBuffer();
+
+  GPUBuffer(const GPUBuffer&) = delete;
+  GPUBuffer& operator=(const GPUBuffer&) = delete;
+
+  GLuint Id() const { return id_; }
+
+  size_t Size() const { return size_; }
+
+  // Replaces the buffer's storage with size bytes, copied from data unless
+  // it is nullptr.
+  void Allocate(size_t size, const void* data, GLenum usage);
+
+  // Writes into storage from Allocate, so a large model can be streamed
+  // in pieces.
+  void Write(size_t offset, size_t size, const void* data);
+
+ private:
+  GLuint id_{0};
+  size_t size_{0};
+};
+
+// Interleaved vertices of one VertexLayout.
+template <typename Layout>
+class VertexBuffer {
+ public:
+  using Vertex = typename Layout::Vertex;
+
+  void Upload(std::span<const Vertex> vertices,
+              GLenum usage = GL_STATIC_DRAW) {
+    buffer_.Allocate(vertices.size_bytes(), vertices.data(), usage);
+    count_ = vertices.size();
+  }
+
+  // Makes room for count vertices, to be written with Write.
+  void Reserve(size_t count, GLenum usage = GL_STATIC_DRAW) {
+    buffer_.Allocate(count * sizeof(Vertex), nullptr, usage);
+    count_ = count;
+  }
+
+  void Write(size_t first, std::span<const Vertex> vertices) {
+    buffer_.Write(first * sizeof(Vertex), vertices.size_bytes(),
+                  vertices.data());
+  }
+
+  GLuint Id() const { return buffer_.Id(); }
+
+  size_t Count() const { return count_; }
+
+ private:
+  GPUBuffer buffer_;
+  size_t count_{0};
+};
+
+template <typename Index>
+constexpr GLenum IndexType() {
+  if constexpr (std::is_same_v<Index, uint8_t>) {
+    return GL_UNSIGNED_BYTE;
+  } else if constexpr (std::is_same_v<Index, uint16_t>) {
+    return GL_UNSIGNED_SHORT;
+  } else if constexpr (std::is_same_v<Index, uint32_t>) {
+    return GL_UNSIGNED_INT;
+  } else {
+    static_assert(sizeof(Index) == 0,
+                  "Indices must be uint8_t, uint16_t or uint32_t.");
+  }
+}
+
+class IndexBuffer {
+ public:
+  template <typename Index>
+  void Upload(std::span<const Index> indices, GLenum usage = GL_STATIC_DRAW) {
+    buffer_.Allocate(indices.size_bytes(), indices.data(), usage);
+    count_ = indices.size();
+    type_ = IndexType<Index>();
+  }
+
+  GLuint Id() const { return buffer_.Id(); }
+
+  size_t Count() const { return count_; }
+
+  // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  GLenum Type() const { return type_; }
+
+ private:
+  GPUBuffer buffer_;
+  size_t count_{0};
+  GLenum type_{GL_UNSIGNED_INT};
+};
+
+// Per-instance data for Mesh::SetInstances; instance i of a draw reads
+// element i.
+template <typename Layout>
+using InstanceBuffer = VertexBuffer<Layout>;
+
+// The attributes a vertex array reads from one buffer. With a divisor of
+// 1 they advance once per instance instead of once per vertex.
+struct VertexStream {
+  std::span<const VertexAttributeFormat> attributes;
+  GLsizei stride;
+  GLuint buffer;
+  GLuint divisor;
+  // Added to the attributes' locations.
+  GLuint first_location;
+};
+
+// Makes a vertex array that reads attributes from the streams, and
+// indices from index_buffer unless it is 0, and leaves it bound.
+GLuint MakeVertexArray(std::span<const VertexStream> streams,
+                       GLuint index_buffer);
+
+// Deletes a vertex array and forgets it in the state cache.
+void DeleteVertexArray(GLuint vao);
+
+// Vertices of one VertexLayout, optional indices, optional per-instance
+// attributes, and the vertex array that binds them to a program's
+// attributes. The buffers can be filled in Scene::Prepare, but vertex
+// arrays are not shared between contexts, so the vertex array is made by
+// the first Bind on the drawing thread.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+template <typename Layout>
+class Mesh {
+ public:
+  using Vertex = typename Layout::Vertex;
+
+  explicit Mesh(GLenum mode = GL_TRIANGLES) : mode_{mode} {}
+
+  ~Mesh() { DeleteVertexArray(vao_); }
+
+  Mesh(const Mesh&) = delete;
+  Mesh& operator=(const Mesh&) = delete;
+
+  void SetVertices(std::span<const Vertex> vertices,
+                   GLenum usage = GL_STATIC_DRAW) {
+    vertices_.Upload(vertices, usage);
+  }
+
+  template <typename Index>
+  void SetIndices(std::span<const Index> indices,
+                  GLenum usage = GL_STATIC_DRAW) {
+    indices_.Upload(indices, usage);
+    // The vertex array may have been made without indices.
+    DeleteVertexArray(vao_);
+    vao_ = 0;
+  }
+
+  // Gives each instance of DrawInstanced its element of instances, which
+  // must outlive the mesh. The instance attributes take the locations
+  // after the vertex attributes: with a vec3 position at location 0, a
+  // glm::mat4 transform takes locations 1 to 4.
+  template <typename InstanceLayout>
+  void SetInstances(const InstanceBuffer<InstanceLayout>& instances) {
+    instances_ = VertexStream{InstanceLayout::kAttributes,
+                              InstanceLayout::kStride, instances.Id(), 1,
+                              Layout::kNumLocations};
+    DeleteVertexArray(vao_);
+    vao_ = 0;
+  }
+
+  VertexBuffer<Layout>& Vertices() { return vertices_; }
+
+  const IndexBuffer& Indices() const { return indices_; }
+
+  // Makes the vertex array if there is none yet and binds it.
+  void Bind() {
+    if (vao_ == 0) {
+      const std::array<VertexStream, 2> streams{
+          VertexStream{Layout::kAttributes, Layout::kStride, vertices_.Id(),
+                       0, 0},
+          instances_};
+      vao_ = MakeVertexArray(
+          std::span{streams}.first(instances_.buffer == 0 ? 1 : 2),
+          indices_.Count() > 0 ? indices_.Id() : 0);
+    } else {
+      GLStateCache::Current().BindVertexArray(vao_);
+    }
+  }
+
+  GLuint VertexArray() const { return vao_; }
+
+  GLenum Mode() const { return mode_; }
+
+  // Binds the mesh and draws every vertex or index.
+  void Draw() {
+    Bind();
+    if (indices_.Count() > 0) {
+      glDrawElements(mode_, static_cast<GLsizei>(indices_.Count()),
+                     indices_.Type(), nullptr);
+    } else {
+      glDrawArrays(mode_, 0, static_cast<GLsizei>(vertices_.Count()));
+    }
+  }
+
+  // Draws the first count instances with one call.
+  void DrawInstanced(GLsizei count) {
+    Bind();
+    if (indices_.Count() > 0) {
+      glDrawElementsInstanced(mode_, static_cast<GLsizei>(indices_.Count()),
+                              indices_.Type(), nullptr, count);
+    } else {
+      glDrawArraysInstanced(mode_, 0, static_cast<GLsizei>(vertices_.Count()),
+                            count);
+    }
+  }
+
+  // Records what Draw does. Bind the mesh once on the drawing thread
+  // first, so that its vertex array exists.
+  void Record(CommandBuffer& commands) const {
+    commands.BindVertexArray(vao_);
+    if (indices_.Count() > 0) {
+      commands.DrawElements(mode_, static_cast<GLsizei>(indices_.Count()),
+                            indices_.Type(), 0);
+    } else {
+      commands.DrawArrays(mode_, 0, static_cast<GLsizei>(vertices_.Count()));
+    }
+  }
+
+  void RecordInstanced(CommandBuffer& commands, GLsizei count) const {
+    commands.BindVertexArray(vao_);
+    if (indices_.Count() > 0) {
+      commands.DrawElementsInstanced(
+          mode_, static_cast<GLsizei>(indices_.Count()), indices_.Type(), 0,
+          count);
+    } else {
+      commands.DrawArraysInstanced(
+          mode_, 0, static_cast<GLsizei>(vertices_.Count()), count);
+    }
+  }
+
+ private:
+  GLenum mode_;
+  GLuint vao_{0};
+  VertexBuffer<Layout> vertices_;
+  IndexBuffer indices_;
+  // No buffer until SetInstances.
+  VertexStream instances_{{}, 0, 0, 1, 0};
+};
+
+#endif
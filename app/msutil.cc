@@ -1,7 +1,8 @@
 
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
-#include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -9,11 +10,24 @@
 #include "glad/gl.h"
 // Must come after glad/gl.h
 #include "msutil.h"
+#include "resourcecache.h"
 
 // NOLINTBEGIN(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
 namespace ms_util {
 
-bool _GLErrorCheck(FILE* out, const char* filename, int line) {
+namespace {
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<GLCheckLevel> g_check_level{
+    static_cast<GLCheckLevel>(MS_GL_CHECK_LEVEL)};
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<unsigned long> g_checks_requested{0};
+std::atomic<unsigned long> g_checks_performed{0};
+std::atomic<unsigned long> g_check_errors{0};
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+bool DrainGLErrors(FILE* out, const char* filename, int line) {
+  g_checks_performed++;
   bool ret = false;
   std::string error_string;
   std::string msg;
@@ -58,11 +72,91 @@ bool _GLErrorCheck(FILE* out, const char* filename, int line) {
         msg = "Unknown error";
     }
     fprintf(out, "%s:%d:GL ERROR(%d): %s\n", filename, line, err, msg.c_str());
+    g_check_errors++;
     err = glGetError();
   }
   return ret;
 }
 
+#ifdef GLAD_OPTION_GL_DEBUG
+// Runs after every GL call when glad's debug wrappers are installed. It
+// calls glad_glGetError directly so it is not itself wrapped.
+void PostCallErrorCheck(void* ret, const char* name, GLADapiproc apiproc,
+                        int len_args, ...) {
+  g_checks_requested++;
+  g_checks_performed++;
+  GLenum err = glad_glGetError();
+  while (err != GL_NO_ERROR) {
+    fprintf(stderr, "GL ERROR(%d) in %s\n", err, name);
+    g_check_errors++;
+    err = glad_glGetError();
+  }
+}
+#endif
+
+}  // namespace
+
+void SetGLCheckLevel(GLCheckLevel level) {
+  g_check_level = static_cast<GLCheckLevel>(
+      std::min(static_cast<int>(level), MS_GL_CHECK_LEVEL));
+}
+
+GLCheckLevel GetGLCheckLevel() { return g_check_level; }
+
+bool StringToGLCheckLevel(const std::string& name, GLCheckLevel& level) {
+  bool found{true};
+  if (name == "off") {
+    level = GLCheckLevel::kOff;
+  } else if (name == "debug") {
+    level = GLCheckLevel::kDebugOutput;
+  } else if (name == "frame") {
+    level = GLCheckLevel::kPerFrame;
+  } else if (name == "call") {
+    level = GLCheckLevel::kPerCall;
+  } else {
+    found = false;
+  }
+  return found;
+}
+
+void ApplyGLCheckLevel() {
+#ifdef GLAD_OPTION_GL_DEBUG
+  if (g_check_level == GLCheckLevel::kPerCall) {
+    gladSetGLPostCallback(PostCallErrorCheck);
+    gladInstallGLDebug();
+  } else {
+    gladUninstallGLDebug();
+  }
+#endif
+}
+
+GLCheckCounters GetGLCheckCounters() {
+  return GLCheckCounters{g_checks_requested, g_checks_performed,
+                         g_check_errors};
+}
+
+void GLCheckReport(FILE* out) {
+  const GLCheckCounters counters{GetGLCheckCounters()};
+  fprintf(out, "GL error checks: %lu requested, %lu performed, %lu errors\n",
+          counters.requested, counters.performed, counters.errors);
+}
+
+bool _GLErrorCheck(FILE* out, const char* filename, int line) {
+  g_checks_requested++;
+  if (g_check_level < GLCheckLevel::kPerCall) {
+    return false;
+  }
+  return DrainGLErrors(out, filename, line);
+}
+
+bool _GLFrameErrorCheck(FILE* out, const char* filename, int line) {
+  g_checks_requested++;
+  if (g_check_level < GLCheckLevel::kPerFrame) {
+    return false;
+  }
+  return DrainGLErrors(out, filename, line);
+}
+
 void GLVersion(bool do_dump_extensions, FILE* out) {
   fprintf(stderr, "Vendor: %s\n", glGetString(GL_VENDOR));
   fprintf(stderr, "Renderer: %s\n", glGetString(GL_RENDERER));
@@ -94,90 +188,72 @@ void GLVersion(bool do_dump_extensions, FILE* out) {
   }
 }
 
-void GLDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
-                     GLsizei length, const GLchar* msg, const void* param) {
-  std::string source_str;
+const char* GLDebugSourceToString(GLenum source) {
   switch (source) {
     case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
-      source_str = "Window System";
-      break;
+      return "Window System";
     case GL_DEBUG_SOURCE_APPLICATION:
-      source_str = "Application";
-      break;
+      return "Application";
     case GL_DEBUG_SOURCE_API:
-      source_str = "OpenGL";
-      break;
+      return "OpenGL";
     case GL_DEBUG_SOURCE_SHADER_COMPILER:
-      source_str = "Shader Compiler";
-      break;
+      return "Shader Compiler";
     case GL_DEBUG_SOURCE_THIRD_PARTY:
-      source_str = "3rd Party";
-      break;
+      return "3rd Party";
     case GL_DEBUG_SOURCE_OTHER:
-      source_str = "Other";
-      break;
+      return "Other";
     default:
-      source_str = "Unknown";
-      break;
+      return "Unknown";
   }
+}
 
-  std::string type_str;
+const char* GLDebugTypeToString(GLenum type) {
   switch (type) {
     case GL_DEBUG_TYPE_ERROR:
-      type_str = "Error";
-      break;
+      return "Error";
     case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-      type_str = "Deprecated";
-      break;
+      return "Deprecated";
     case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
-      type_str = "Undefined";
-      break;
+      return "Undefined";
     case GL_DEBUG_TYPE_PORTABILITY:
-      type_str = "Portability";
-      break;
+      return "Portability";
     case GL_DEBUG_TYPE_PERFORMANCE:
-      type_str = "Performance";
-      break;
+      return "Performance";
     case GL_DEBUG_TYPE_MARKER:
-      type_str = "Marker";
-      break;
+      return "Marker";
     case GL_DEBUG_TYPE_PUSH_GROUP:
-      type_str = "Push Group";
-      break;
+      return "Push Group";
     case GL_DEBUG_TYPE_POP_GROUP:
-      type_str = "Pop Group";
-      break;
+      return "Pop Group";
     case GL_DEBUG_TYPE_OTHER:
-      type_str = "Other";
-      break;
+      return "Other";
     default:
-      type_str = "Unknown";
-      break;
+      return "Unknown";
   }
+}
 
-  std::string severity_str;
+const char* GLDebugSeverityToString(GLenum severity) {
   switch (severity) {
     case GL_DEBUG_SEVERITY_HIGH:
-      severity_str = "HIGH";
-      break;
+      return "HIGH";
     case GL_DEBUG_SEVERITY_MEDIUM:
-      severity_str = "MEDIUM";
-      break;
+      return "MEDIUM";
     case GL_DEBUG_SEVERITY_LOW:
-      severity_str = "LOW";
-      break;
+      return "LOW";
     case GL_DEBUG_SEVERITY_NOTIFICATION:
-      severity_str = "NOTIFY";
-      break;
+      return "NOTIFY";
     default:
-      severity_str = "UNKOWN";
-      break;
+      return "UNKNOWN";
   }
-  fprintf(stderr, "%s(%d):%s(%d) [%s] (id: %d) \"%s\"\n", source_str.c_str(),
-          source, type_str.c_str(), type, severity_str.c_str(), id, msg);
-  // std::cerr << source_str << ":" << type_str << "[" << sev_str << "]" << "("
-  // << id << "): " << msg << std::endl;
 }
+
+void GLDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                     GLsizei length, const GLchar* msg, const void* param) {
+  fprintf(stderr, "%s(%d):%s(%d) [%s] (id: %d) \"%s\"\n",
+          GLDebugSourceToString(source), source, GLDebugTypeToString(type),
+          type, GLDebugSeverityToString(severity), id, msg);
+}
+
 void GLFWErrorCallback(int error, const char* description) {
   fprintf(stderr, "GLFW Error (%d): \"%s\"\n", error, description);
   fprintf(stderr,
@@ -276,15 +352,12 @@ glm::quat Trackballx(const glm::vec2& previous_mous_pos,
 }
 
 bool FileToString(const std::string& file_path, std::string& contents) {
-  bool status{false};
-  std::ifstream input_file_stream{file_path};
-  if (input_file_stream.is_open()) {
-    contents = std::string((std::istreambuf_iterator<char>(input_file_stream)),
-                           (std::istreambuf_iterator<char>()));
-    input_file_stream.close();
-    status = true;
+  const auto file{ResourceCache::Instance().TryMap(file_path)};
+  if (not file) {
+    return false;
   }
-  return status;
+  contents.assign(file->Text());
+  return true;
 }
 
 // void SaveColorBufferToFile(const size_t width, const size_t height, const std::string& output_file_name) {
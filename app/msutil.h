@@ -2,23 +2,99 @@
 #ifndef MSUTIL_H_
 #define MSUTIL_H_
 
+#include "glad/gl.h"
+
 #include <GLFW/glfw3.h>
 
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <glm/glm.hpp>
 #include <string>
+#include <string_view>
+
+// The most GL error checking a build can do; see GLCheckLevel. Build with
+// -DMS_GL_CHECK_LEVEL=0 for a release build where the checks compile away.
+#ifndef MS_GL_CHECK_LEVEL
+#define MS_GL_CHECK_LEVEL 3
+#endif
 
 namespace ms_util {
 
+// How GL errors are caught, cheapest first.
+//  kOff: never; the context is created with KHR_no_error when possible.
+//  kDebugOutput: only through the debug message callback, no glGetError.
+//  kPerFrame: GLFrameErrorCheck drains glGetError once per frame.
+//  kPerCall: GLErrorCheck drains glGetError where it is called and, when
+//            glad was generated with --debug, after every GL call so the
+//            failing function is named.
+enum class GLCheckLevel {
+  kOff = 0,
+  kDebugOutput = 1,
+  kPerFrame = 2,
+  kPerCall = 3
+};
+
+// Set before creating the GLFWApp. The level is capped at
+// MS_GL_CHECK_LEVEL.
+void SetGLCheckLevel(GLCheckLevel level);
+
+GLCheckLevel GetGLCheckLevel();
+
+// Accepts "off", "debug", "frame" and "call".
+bool StringToGLCheckLevel(const std::string& name, GLCheckLevel& level);
+
+// Installs or removes glad's per-call hooks to match the check level. Call
+// after loading GL.
+void ApplyGLCheckLevel();
+
+struct GLCheckCounters {
+  // Checks the code asked for.
+  unsigned long requested{0};
+  // Checks that called glGetError.
+  unsigned long performed{0};
+  unsigned long errors{0};
+};
+
+GLCheckCounters GetGLCheckCounters();
+
+void GLCheckReport(FILE* out = stderr);
+
 // NOLINTNEXTLINE(readability-identifier-naming,bugprone-reserved-identifier)
 bool _GLErrorCheck(FILE* out, const char* filename, int line);
 
+// NOLINTNEXTLINE(readability-identifier-naming,bugprone-reserved-identifier)
+bool _GLFrameErrorCheck(FILE* out, const char* filename, int line);
+
+// NOLINTNEXTLINE(readability-identifier-naming,bugprone-reserved-identifier)
+inline bool _GLErrorCheckCompiledOut() { return false; }
+
+#if MS_GL_CHECK_LEVEL >= 3
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage,readability-identifier-naming)
 #define GLErrorCheck() _GLErrorCheck(stderr, __FILE__, __LINE__)
+#else
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage,readability-identifier-naming)
+#define GLErrorCheck() _GLErrorCheckCompiledOut()
+#endif
+
+#if MS_GL_CHECK_LEVEL >= 2
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage,readability-identifier-naming)
+#define GLFrameErrorCheck() _GLFrameErrorCheck(stderr, __FILE__, __LINE__)
+#else
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage,readability-identifier-naming)
+#define GLFrameErrorCheck() _GLErrorCheckCompiledOut()
+#endif
 
 void GLVersion(bool do_dump_extensions = false, FILE* out = stderr);
 
+const char* GLDebugSourceToString(GLenum source);
+
+const char* GLDebugTypeToString(GLenum type);
+
+const char* GLDebugSeverityToString(GLenum severity);
+
+// Prints each message as it arrives on the driver's thread; see GLDebugLog
+// for a cheaper callback.
 void GLDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
                      GLsizei length, const GLchar* msg, const void* param);
 
@@ -27,7 +103,26 @@ void GLFWErrorCallback(int error, const char* description);
 glm::quat Trackballx(const glm::vec2& previous_mous_pos,
                      const glm::vec2& current_mous_pos);
 
+// Copies the file from its ResourceCache mapping. Code that only reads the
+// contents can use the mapping itself.
 bool FileToString(const std::string& file_path, std::string& contents);
 
+constexpr uint64_t kFnv1aOffsetBasis{0xcbf29ce484222325ULL};
+
+// 64-bit FNV-1a. Chain calls by passing the previous hash as the basis.
+constexpr uint64_t Fnv1a64(std::string_view bytes,
+                           uint64_t hash = kFnv1aOffsetBasis) {
+  for (const char byte : bytes) {
+    hash ^= static_cast<uint8_t>(byte);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// The smallest multiple of alignment that is at least value.
+constexpr size_t RoundUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
 }  // namespace ms_util
 #endif  // MSUTIL_H
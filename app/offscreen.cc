@@ -0,0 +1,45 @@
+
+#include "offscreen.h"
+
+#include <sstream>
+
+#include "glstate.h"
+#include "msutil.h"
+
+OffscreenFramebuffer::OffscreenFramebuffer(int width, int height)
+    : width_{width}, height_{height} {
+  glGenRenderbuffers(1, &color_);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+
+  glGenRenderbuffers(1, &depth_stencil_);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width_, height_);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &fbo_);
+  GLStateCache::Current().BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, depth_stencil_);
+  const GLenum status{glCheckFramebufferStatus(GL_FRAMEBUFFER)};
+  ms_util::GLErrorCheck();
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::ostringstream msg;
+    msg << "Offscreen framebuffer is incomplete (status 0x" << std::hex
+        << status << ").\n";
+    throw OffscreenException(msg.str());
+  }
+}
+
+OffscreenFramebuffer::~OffscreenFramebuffer() {
+  GLStateCache::Current().ForgetFramebuffer(fbo_);
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteRenderbuffers(1, &depth_stencil_);
+  glDeleteRenderbuffers(1, &color_);
+}
+
+void OffscreenFramebuffer::Bind() const {
+  GLStateCache::Current().BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+}
@@ -0,0 +1,43 @@
+#ifndef OFFSCREEN_H_
+#define OFFSCREEN_H_
+
+#include <stdexcept>
+#include <string>
+
+#include "glad/gl.h"
+
+class OffscreenException : public std::runtime_error {
+ public:
+  explicit OffscreenException(const std::string& msg)
+      : std::runtime_error(msg) {}
+};
+
+// A framebuffer object with a color and a depth/stencil renderbuffer. When
+// the application runs headless, scenes draw into this instead of a window.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class OffscreenFramebuffer {
+ public:
+  OffscreenFramebuffer(int width, int height);
+
+  ~OffscreenFramebuffer();
+
+  OffscreenFramebuffer(const OffscreenFramebuffer&) = delete;
+  OffscreenFramebuffer& operator=(const OffscreenFramebuffer&) = delete;
+
+  void Bind() const;
+
+  GLuint Id() const { return fbo_; }
+
+  int Width() const { return width_; }
+
+  int Height() const { return height_; }
+
+ private:
+  GLuint fbo_{0};
+  GLuint color_{0};
+  GLuint depth_stencil_{0};
+  int width_;
+  int height_;
+};
+
+#endif
@@ -0,0 +1,221 @@
+
+#include "programcache.h"
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include "glslshader.h"
+#include "msutil.h"
+#include "resourcecache.h"
+
+namespace {
+
+// "MSPB" in a little endian file.
+constexpr uint32_t kMagic{0x4250534d};
+constexpr uint32_t kFileVersion{2};
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t length;
+  uint32_t reflection_length;
+  double compile_ms;
+};
+
+uint64_t HashString(const GLubyte* text, uint64_t hash) {
+  if (text != nullptr) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    hash = ms_util::Fnv1a64(reinterpret_cast<const char*>(text), hash);
+  }
+  // Separates fields so that moving bytes between them changes the hash.
+  return ms_util::Fnv1a64(std::string_view{"\0", 1}, hash);
+}
+
+bool SupportsProgramBinaries() {
+  GLint num_formats{0};
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  return num_formats > 0;
+}
+
+}  // namespace
+
+ProgramBinaryCache& ProgramBinaryCache::Instance() {
+  static ProgramBinaryCache cache;
+  return cache;
+}
+
+void ProgramBinaryCache::SetDirectory(const std::string& directory) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  directory_ = directory;
+}
+
+std::filesystem::path ProgramBinaryCache::Directory() const {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  return directory_;
+}
+
+uint64_t ProgramBinaryCache::Key(const std::vector<Stage>& stages) const {
+  uint64_t hash{ms_util::kFnv1aOffsetBasis};
+  hash = HashString(glGetString(GL_VENDOR), hash);
+  hash = HashString(glGetString(GL_RENDERER), hash);
+  hash = HashString(glGetString(GL_VERSION), hash);
+  for (const auto& [type, source] : stages) {
+    const std::string type_string{std::to_string(type)};
+    hash = ms_util::Fnv1a64(type_string, hash);
+    hash = ms_util::Fnv1a64(std::string_view{"\0", 1}, hash);
+    hash = ms_util::Fnv1a64(source, hash);
+    hash = ms_util::Fnv1a64(std::string_view{"\0", 1}, hash);
+  }
+  return hash;
+}
+
+std::string ProgramBinaryCache::PathFor(uint64_t key) const {
+  std::array<char, 17> name{};
+  snprintf(name.data(), name.size(), "%016" PRIx64, key);
+  return directory_ + "/" + name.data() + ".bin";
+}
+
+bool ProgramBinaryCache::Load(uint64_t key, GLSLProgram& program) {
+  std::string path;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    if (directory_.empty()) {
+      return false;
+    }
+    path = PathFor(key);
+  }
+  if (not SupportsProgramBinaries()) {
+    return false;
+  }
+  const auto start{std::chrono::steady_clock::now()};
+  // Mapped rather than read, so the driver reads the binary from the page
+  // cache. Binaries are loaded once each, so they bypass the
+  // ResourceCache.
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(path);
+  } catch (const ResourceException&) {
+  }
+  FileHeader header{};
+  std::string_view binary;
+  std::string_view reflection_data;
+  if (file and file->Size() >= sizeof(header)) {
+    std::memcpy(&header, file->Text().data(), sizeof(header));
+    if (header.magic == kMagic and header.version == kFileVersion and
+        file->Size() >= sizeof(header) + header.length +
+                            header.reflection_length) {
+      binary = file->Text().substr(sizeof(header), header.length);
+      reflection_data = file->Text().substr(sizeof(header) + header.length,
+                                            header.reflection_length);
+    }
+  }
+  if (binary.empty()) {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stats_.misses++;
+    return false;
+  }
+  // The program is queried instead if the saved reflection is unusable.
+  ProgramReflection reflection;
+  const bool has_reflection{
+      ProgramReflection::Deserialize(reflection_data, reflection)};
+  const bool loaded{program.LoadBinary(
+      header.format, binary.data(), static_cast<GLsizei>(binary.size()),
+      has_reflection ? &reflection : nullptr)};
+  file.reset();
+  const double load_ms{std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count()};
+  const std::lock_guard<std::mutex> lock{mutex_};
+  if (not loaded) {
+    stats_.misses++;
+    stats_.rejected++;
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return false;
+  }
+  stats_.hits++;
+  stats_.saved_ms += header.compile_ms - load_ms;
+  return true;
+}
+
+bool ProgramBinaryCache::Store(uint64_t key, const GLSLProgram& program,
+                               double compile_ms) {
+  std::string directory;
+  std::string path;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    directory = directory_;
+    path = PathFor(key);
+  }
+  if (directory.empty() or not SupportsProgramBinaries()) {
+    return false;
+  }
+  GLenum format{0};
+  std::vector<char> binary;
+  if (not program.GetBinary(format, binary)) {
+    return false;
+  }
+  std::vector<char> reflection_data;
+  program.Reflection().Serialize(reflection_data);
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  // Write to a temporary file and rename it so that a program starting at
+  // the same time never reads half a binary.
+  const std::string temporary_path{path + ".tmp"};
+  {
+    std::ofstream out{temporary_path, std::ios::binary | std::ios::trunc};
+    if (not out.is_open()) {
+      return false;
+    }
+    const FileHeader header{kMagic,
+                            kFileVersion,
+                            format,
+                            static_cast<uint32_t>(binary.size()),
+                            static_cast<uint32_t>(reflection_data.size()),
+                            compile_ms};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+    out.write(reflection_data.data(),
+              static_cast<std::streamsize>(reflection_data.size()));
+    if (not out) {
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  const std::lock_guard<std::mutex> lock{mutex_};
+  stats_.stores++;
+  return true;
+}
+
+ProgramCacheStats ProgramBinaryCache::Stats() const {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  return stats_;
+}
+
+std::ostream& operator<<(std::ostream& out, const ProgramBinaryCache& cache) {
+  const ProgramCacheStats stats{cache.Stats()};
+  const unsigned long lookups{stats.hits + stats.misses};
+  out << "Program binary cache: " << stats.hits << " hits, " << stats.misses
+      << " misses (" << stats.rejected << " rejected)";
+  if (lookups > 0) {
+    out << ", " << std::fixed << std::setprecision(1)
+        << (100.0 * stats.hits / lookups) << "% hit rate" << std::defaultfloat;
+  }
+  out << ", " << stats.stores << " stored, " << std::fixed
+      << std::setprecision(3) << stats.saved_ms << " ms saved\n"
+      << std::defaultfloat;
+  return out;
+}
@@ -0,0 +1,72 @@
+#ifndef PROGRAMCACHE_H_
+#define PROGRAMCACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glad/gl.h"
+
+class GLSLProgram;
+
+struct ProgramCacheStats {
+  unsigned long hits{0};
+  unsigned long misses{0};
+  // Binaries the driver refused, e.g. after a driver update. Counted as
+  // misses too.
+  unsigned long rejected{0};
+  unsigned long stores{0};
+  // Compile and link time avoided by hits, less the time spent loading.
+  double saved_ms{0.0};
+};
+
+// Keeps linked programs on disk with glGetProgramBinary, together with
+// their ProgramReflection, so the next run can skip compiling, linking and
+// introspection. A program's key hashes its stage sources
+// together with GL_VENDOR, GL_RENDERER and GL_VERSION, so a different
+// driver or GPU misses instead of loading a binary it cannot use. If the
+// driver rejects a binary anyway, the program is compiled from source and
+// the entry is replaced.
+class ProgramBinaryCache {
+ public:
+  // A stage's type and source.
+  using Stage = std::pair<GLenum, std::string>;
+
+  static ProgramBinaryCache& Instance();
+
+  // An empty directory disables the cache.
+  void SetDirectory(const std::string& directory);
+
+  // A copy, since another thread may change the directory.
+  std::filesystem::path Directory() const;
+
+  // Needs a current context.
+  uint64_t Key(const std::vector<Stage>& stages) const;
+
+  // Loads the binary stored under key into program and links it. Returns
+  // false on a miss or when the driver rejects the binary.
+  bool Load(uint64_t key, GLSLProgram& program);
+
+  // Saves a program linked from source; compile_ms is how long compiling
+  // and linking took.
+  bool Store(uint64_t key, const GLSLProgram& program, double compile_ms);
+
+  ProgramCacheStats Stats() const;
+
+ private:
+  ProgramBinaryCache() = default;
+
+  std::string PathFor(uint64_t key) const;
+
+  std::string directory_{"shader_cache"};
+  mutable std::mutex mutex_;
+  ProgramCacheStats stats_;
+};
+
+std::ostream& operator<<(std::ostream& out, const ProgramBinaryCache& cache);
+
+#endif
@@ -0,0 +1,348 @@
+
+#include "programreflection.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <type_traits>
+#include <utility>
+
+#include "glslshader.h"
+#include "msutil.h"
+
+namespace {
+
+// "MSPR" in a little endian file.
+constexpr uint32_t kMagic{0x5250534d};
+constexpr uint32_t kVersion{1};
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_uniforms;
+  uint32_t num_blocks;
+  uint32_t num_block_members;
+  uint32_t num_attributes;
+  uint32_t num_locations;
+  uint32_t names_size;
+};
+
+template <typename T>
+void Append(std::vector<char>& data, const std::vector<T>& values) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const size_t at{data.size()};
+  data.resize(at + values.size() * sizeof(T));
+  std::memcpy(data.data() + at, values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+void Extract(const char*& at, size_t count, std::vector<T>& values) {
+  values.resize(count);
+  std::memcpy(values.data(), at, count * sizeof(T));
+  at += count * sizeof(T);
+}
+
+const char kRule[]{"------------------------------------------------\n"};
+
+}  // namespace
+
+ProgramReflection ProgramReflection::Query(GLuint program) {
+  ProgramReflection reflection;
+  // One name buffer, long enough for any name.
+  GLint max_uniform_length{0};
+  GLint max_block_length{0};
+  GLint max_attribute_length{0};
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_uniform_length);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &max_block_length);
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH,
+                 &max_attribute_length);
+  std::vector<GLchar> name(std::max(
+      {max_uniform_length, max_block_length, max_attribute_length, 1}));
+  GLsizei written{0};
+
+  GLint num_uniforms{0};
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+  if (num_uniforms > 0) {
+    std::vector<GLuint> indices(num_uniforms);
+    for (GLint i = 0; i < num_uniforms; i++) {
+      indices[i] = static_cast<GLuint>(i);
+    }
+    // One query per property for all the uniforms at once.
+    const auto query{[&](GLenum property) {
+      std::vector<GLint> values(num_uniforms);
+      glGetActiveUniformsiv(program, num_uniforms, indices.data(), property,
+                            values.data());
+      return values;
+    }};
+    const std::vector<GLint> types{query(GL_UNIFORM_TYPE)};
+    const std::vector<GLint> sizes{query(GL_UNIFORM_SIZE)};
+    const std::vector<GLint> blocks{query(GL_UNIFORM_BLOCK_INDEX)};
+    const std::vector<GLint> offsets{query(GL_UNIFORM_OFFSET)};
+    const std::vector<GLint> array_strides{query(GL_UNIFORM_ARRAY_STRIDE)};
+    const std::vector<GLint> matrix_strides{query(GL_UNIFORM_MATRIX_STRIDE)};
+    reflection.uniforms_.reserve(num_uniforms);
+    for (GLint i = 0; i < num_uniforms; i++) {
+      glGetActiveUniformName(program, indices[i], name.size(), &written,
+                             name.data());
+      const std::string_view uniform_name{name.data(),
+                                          static_cast<size_t>(written)};
+      const GLint location{blocks[i] < 0
+                               ? glGetUniformLocation(program, name.data())
+                               : -1};
+      reflection.uniforms_.push_back(ReflectedUniform{
+          reflection.Intern(uniform_name), static_cast<GLenum>(types[i]),
+          sizes[i], location, blocks[i], offsets[i], array_strides[i],
+          matrix_strides[i]});
+      if (location < 0) {
+        continue;
+      }
+      reflection.locations_.push_back(
+          Location{ms_util::Fnv1a64(uniform_name), location});
+      // Arrays are reported as name[0] but may be set by name alone.
+      if (uniform_name.ends_with("[0]")) {
+        reflection.locations_.push_back(Location{
+            ms_util::Fnv1a64(uniform_name.substr(0, uniform_name.size() - 3)),
+            location});
+      }
+    }
+    std::sort(reflection.locations_.begin(), reflection.locations_.end(),
+              [](const Location& a, const Location& b) {
+                return a.hash < b.hash;
+              });
+  }
+
+  GLint num_blocks{0};
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+  for (GLint i = 0; i < num_blocks; i++) {
+    const auto index{static_cast<GLuint>(i)};
+    glGetActiveUniformBlockName(program, index, name.size(), &written,
+                                name.data());
+    GLint binding{0};
+    GLint data_size{0};
+    GLint num_members{0};
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_BINDING,
+                              &binding);
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE,
+                              &data_size);
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS,
+                              &num_members);
+    const auto first_member{
+        static_cast<uint32_t>(reflection.block_members_.size())};
+    std::vector<GLint> members(num_members);
+    glGetActiveUniformBlockiv(program, index,
+                              GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES,
+                              members.data());
+    reflection.block_members_.insert(reflection.block_members_.end(),
+                                     members.begin(), members.end());
+    reflection.blocks_.push_back(ReflectedBlock{
+        reflection.Intern({name.data(), static_cast<size_t>(written)}),
+        static_cast<GLuint>(binding), data_size, first_member,
+        static_cast<uint32_t>(num_members)});
+  }
+
+  GLint num_attributes{0};
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &num_attributes);
+  for (GLint i = 0; i < num_attributes; i++) {
+    GLint size{0};
+    GLenum type{0};
+    glGetActiveAttrib(program, static_cast<GLuint>(i), name.size(), &written,
+                      &size, &type, name.data());
+    reflection.attributes_.push_back(ReflectedAttribute{
+        reflection.Intern({name.data(), static_cast<size_t>(written)}), type,
+        size, glGetAttribLocation(program, name.data())});
+  }
+  return reflection;
+}
+
+uint32_t ProgramReflection::Intern(std::string_view name) {
+  if (names_.empty()) {
+    // Every name, even the first, follows a NUL.
+    names_.push_back('\0');
+  }
+  std::string needle{'\0'};
+  needle += name;
+  needle += '\0';
+  const size_t found{names_.find(needle)};
+  if (found != std::string::npos) {
+    return static_cast<uint32_t>(found + 1);
+  }
+  const auto offset{static_cast<uint32_t>(names_.size())};
+  names_ += name;
+  names_.push_back('\0');
+  return offset;
+}
+
+GLint ProgramReflection::UniformLocation(uint64_t name_hash) const {
+  const auto found{std::lower_bound(
+      locations_.begin(), locations_.end(), name_hash,
+      [](const Location& entry, uint64_t hash) { return entry.hash < hash; })};
+  if (found == locations_.end() or found->hash != name_hash) {
+    return -1;
+  }
+  return found->location;
+}
+
+void ProgramReflection::AddUniformLocation(uint64_t name_hash,
+                                           GLint location) {
+  const auto found{std::lower_bound(
+      locations_.begin(), locations_.end(), name_hash,
+      [](const Location& entry, uint64_t hash) { return entry.hash < hash; })};
+  if (found == locations_.end() or found->hash != name_hash) {
+    locations_.insert(found, Location{name_hash, location});
+  }
+}
+
+const ReflectedBlock* ProgramReflection::FindBlock(
+    std::string_view name) const {
+  const auto found{
+      std::find_if(blocks_.begin(), blocks_.end(),
+                   [&](const ReflectedBlock& block) {
+                     return Name(block.name) == name;
+                   })};
+  return found == blocks_.end() ? nullptr : &*found;
+}
+
+const ReflectedAttribute* ProgramReflection::FindAttribute(
+    std::string_view name) const {
+  const auto found{
+      std::find_if(attributes_.begin(), attributes_.end(),
+                   [&](const ReflectedAttribute& attribute) {
+                     return Name(attribute.name) == name;
+                   })};
+  return found == attributes_.end() ? nullptr : &*found;
+}
+
+void ProgramReflection::SetBlockBinding(const ReflectedBlock& block,
+                                        GLuint binding) {
+  blocks_[&block - blocks_.data()].binding = binding;
+}
+
+void ProgramReflection::Serialize(std::vector<char>& data) const {
+  const SnapshotHeader header{kMagic,
+                              kVersion,
+                              static_cast<uint32_t>(uniforms_.size()),
+                              static_cast<uint32_t>(blocks_.size()),
+                              static_cast<uint32_t>(block_members_.size()),
+                              static_cast<uint32_t>(attributes_.size()),
+                              static_cast<uint32_t>(locations_.size()),
+                              static_cast<uint32_t>(names_.size())};
+  data.resize(sizeof(header));
+  std::memcpy(data.data(), &header, sizeof(header));
+  Append(data, uniforms_);
+  Append(data, blocks_);
+  Append(data, block_members_);
+  Append(data, attributes_);
+  // A Location has padding after its location, which is left zero so that
+  // the same program always makes the same bytes.
+  const size_t at{data.size()};
+  data.resize(at + locations_.size() * sizeof(Location));
+  for (size_t i = 0; i < locations_.size(); i++) {
+    char* entry{data.data() + at + i * sizeof(Location)};
+    std::memcpy(entry + offsetof(Location, hash), &locations_[i].hash,
+                sizeof(locations_[i].hash));
+    std::memcpy(entry + offsetof(Location, location),
+                &locations_[i].location, sizeof(locations_[i].location));
+  }
+  data.insert(data.end(), names_.begin(), names_.end());
+}
+
+bool ProgramReflection::Deserialize(std::span<const char> data,
+                                    ProgramReflection& reflection) {
+  SnapshotHeader header{};
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  const size_t expected{
+      sizeof(header) + header.num_uniforms * sizeof(ReflectedUniform) +
+      header.num_blocks * sizeof(ReflectedBlock) +
+      header.num_block_members * sizeof(uint32_t) +
+      header.num_attributes * sizeof(ReflectedAttribute) +
+      header.num_locations * sizeof(Location) +
+      header.names_size};
+  if (header.magic != kMagic or header.version != kVersion or
+      data.size() != expected) {
+    return false;
+  }
+  ProgramReflection snapshot;
+  const char* at{data.data() + sizeof(header)};
+  Extract(at, header.num_uniforms, snapshot.uniforms_);
+  Extract(at, header.num_blocks, snapshot.blocks_);
+  Extract(at, header.num_block_members, snapshot.block_members_);
+  Extract(at, header.num_attributes, snapshot.attributes_);
+  Extract(at, header.num_locations, snapshot.locations_);
+  snapshot.names_.assign(at, header.names_size);
+
+  // A damaged file of the right size must not index out of the snapshot.
+  if (not snapshot.names_.empty() and snapshot.names_.back() != '\0') {
+    return false;
+  }
+  const auto valid_name{
+      [&](uint32_t name) { return name < snapshot.names_.size(); }};
+  for (const ReflectedUniform& uniform : snapshot.uniforms_) {
+    if (not valid_name(uniform.name) or
+        uniform.block >= static_cast<int64_t>(header.num_blocks)) {
+      return false;
+    }
+  }
+  for (const ReflectedBlock& block : snapshot.blocks_) {
+    if (not valid_name(block.name) or
+        uint64_t{block.first_member} + block.num_members >
+            header.num_block_members) {
+      return false;
+    }
+  }
+  for (const uint32_t member : snapshot.block_members_) {
+    if (member >= header.num_uniforms) {
+      return false;
+    }
+  }
+  for (const ReflectedAttribute& attribute : snapshot.attributes_) {
+    if (not valid_name(attribute.name)) {
+      return false;
+    }
+  }
+  reflection = std::move(snapshot);
+  return true;
+}
+
+void ProgramReflection::PrintUniforms(std::ostream& out) const {
+  out << "Active uniforms:\n" << kRule;
+  for (const ReflectedUniform& uniform : uniforms_) {
+    if (uniform.block >= 0) {
+      continue;
+    }
+    out << " " << std::left << std::setw(5) << uniform.location << std::right
+        << " " << Name(uniform.name) << " (" << GetTypeString(uniform.type)
+        << ")\n";
+  }
+  out << kRule;
+}
+
+void ProgramReflection::PrintBlocks(std::ostream& out) const {
+  out << "Active uniform blocks:\n" << kRule;
+  for (const ReflectedBlock& block : blocks_) {
+    out << "Uniform block \"" << Name(block.name) << "\" (binding "
+        << block.binding << ", " << block.data_size << " bytes):\n";
+    for (uint32_t i = 0; i < block.num_members; i++) {
+      const ReflectedUniform& member{
+          uniforms_[block_members_[block.first_member + i]]};
+      out << "    " << std::left << std::setw(5) << member.offset
+          << std::right << " " << Name(member.name) << " ("
+          << GetTypeString(member.type) << ")\n";
+    }
+  }
+  out << kRule;
+}
+
+void ProgramReflection::PrintAttributes(std::ostream& out) const {
+  out << "Active attributes:\n" << kRule;
+  for (const ReflectedAttribute& attribute : attributes_) {
+    out << " " << std::left << std::setw(5) << attribute.location
+        << std::right << " " << Name(attribute.name) << " ("
+        << GetTypeString(attribute.type) << ")\n";
+  }
+  out << kRule;
+}
@@ -0,0 +1,118 @@
+#ifndef PROGRAMREFLECTION_H_
+#define PROGRAMREFLECTION_H_
+
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "glad/gl.h"
+
+// The entries refer to their names by offset into the reflection's name
+// pool, so they are plain data and can be saved as they are.
+struct ReflectedUniform {
+  uint32_t name;
+  GLenum type;
+  // The number of elements of an array, otherwise 1.
+  GLint size;
+  // -1 for members of blocks.
+  GLint location;
+  // -1 unless the uniform is a member of a block.
+  GLint block;
+  GLint offset;
+  GLint array_stride;
+  GLint matrix_stride;
+};
+
+struct ReflectedBlock {
+  uint32_t name;
+  GLuint binding;
+  GLint data_size;
+  // The block's members are MemberIndices()[first_member] onward.
+  uint32_t first_member;
+  uint32_t num_members;
+};
+
+struct ReflectedAttribute {
+  uint32_t name;
+  GLenum type;
+  GLint size;
+  GLint location;
+};
+
+// What a linked program's interface looks like: its uniforms, uniform
+// blocks and vertex attributes with their types, locations and offsets.
+// Query asks GL once, with the OpenGL 3.1 queries that macOS has too;
+// everything afterward reads the snapshot, including printing and uniform
+// lookups. The snapshot is saved next to a program binary so that a
+// program loaded from the cache needs no queries at all.
+class ProgramReflection {
+ public:
+  // Needs a current context and a linked program.
+  static ProgramReflection Query(GLuint program);
+
+  // Returns false, leaving reflection as it was, if data is not a whole,
+  // consistent snapshot from Serialize.
+  static bool Deserialize(std::span<const char> data,
+                          ProgramReflection& reflection);
+
+  void Serialize(std::vector<char>& data) const;
+
+  std::span<const ReflectedUniform> Uniforms() const { return uniforms_; }
+
+  std::span<const ReflectedBlock> Blocks() const { return blocks_; }
+
+  // Indices into Uniforms().
+  std::span<const uint32_t> MemberIndices() const { return block_members_; }
+
+  std::span<const ReflectedAttribute> Attributes() const {
+    return attributes_;
+  }
+
+  std::string_view Name(uint32_t name) const {
+    return std::string_view{names_.c_str() + name};
+  }
+
+  // -1 if there is no active uniform with that name hash. An array is
+  // found by name and by name[0].
+  GLint UniformLocation(uint64_t name_hash) const;
+
+  // Remembers the location of a name that is not an active uniform as
+  // such, such as an element of an array.
+  void AddUniformLocation(uint64_t name_hash, GLint location);
+
+  // nullptr if there is none.
+  const ReflectedBlock* FindBlock(std::string_view name) const;
+
+  const ReflectedAttribute* FindAttribute(std::string_view name) const;
+
+  // Records a binding made with glUniformBlockBinding.
+  void SetBlockBinding(const ReflectedBlock& block, GLuint binding);
+
+  void PrintUniforms(std::ostream& out) const;
+
+  void PrintBlocks(std::ostream& out) const;
+
+  void PrintAttributes(std::ostream& out) const;
+
+ private:
+  struct Location {
+    uint64_t hash;
+    GLint location;
+  };
+
+  uint32_t Intern(std::string_view name);
+
+  std::vector<ReflectedUniform> uniforms_;
+  std::vector<ReflectedBlock> blocks_;
+  std::vector<uint32_t> block_members_;
+  std::vector<ReflectedAttribute> attributes_;
+  // Sorted by hash.
+  std::vector<Location> locations_;
+  // NUL terminated names, each stored once.
+  std::string names_;
+};
+
+#endif
@@ -0,0 +1,236 @@
+
+#include "resourcecache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+int64_t WriteTimeNs(const struct stat& status) {
+#ifdef __APPLE__
+  const struct timespec& time{status.st_mtimespec};
+#else
+  const struct timespec& time{status.st_mtim};
+#endif
+  constexpr int64_t kNsPerSecond{1000000000};
+  return static_cast<int64_t>(time.tv_sec) * kNsPerSecond + time.tv_nsec;
+}
+
+std::string ErrorMessage(const std::string& what, const std::string& path) {
+  return "Could not " + what + " " + path + ": " + std::strerror(errno) +
+         ".\n";
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) : path_{path} {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg,hicpp-vararg)
+  const int fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd < 0) {
+    throw ResourceException(ErrorMessage("open", path));
+  }
+  struct stat status {};
+  if (fstat(fd, &status) != 0) {
+    const std::string msg{ErrorMessage("stat", path)};
+    close(fd);
+    throw ResourceException(msg);
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  inode_ = static_cast<uint64_t>(status.st_ino);
+  write_time_ = WriteTimeNs(status);
+  // Small files are copied; see kMaxCopySize. An empty file cannot be
+  // mapped, and needs neither.
+  if (size_ > 0 and size_ <= kMaxCopySize) {
+    copy_.resize(size_);
+    size_t copied{0};
+    while (copied < size_) {
+      const ssize_t count{read(fd, copy_.data() + copied, size_ - copied)};
+      if (count < 0 and errno == EINTR) {
+        continue;
+      }
+      if (count < 0) {
+        const std::string msg{ErrorMessage("read", path)};
+        close(fd);
+        throw ResourceException(msg);
+      }
+      if (count == 0) {
+        // Truncated since fstat, which changed its write time, so
+        // ResourceCache reads it again on the next Map.
+        break;
+      }
+      copied += static_cast<size_t>(count);
+    }
+    copy_.resize(copied);
+    size_ = copied;
+    data_ = copy_.empty() ? nullptr : copy_.data();
+  } else if (size_ > 0) {
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      const std::string msg{ErrorMessage("map", path)};
+      close(fd);
+      throw ResourceException(msg);
+    }
+  }
+  // The mapping keeps the file open.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr and copy_.empty()) {
+    munmap(data_, size_);
+  }
+}
+
+void MappedFile::Prefetch() const {
+  if (data_ == nullptr or not copy_.empty()) {
+    return;
+  }
+  madvise(data_, size_, MADV_WILLNEED);
+  // The advice may be ignored; touching a byte of each page is not.
+  const auto page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+  const auto* bytes{static_cast<const volatile char*>(data_)};
+  for (size_t at = 0; at < size_; at += page_size) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    static_cast<void>(bytes[at]);
+  }
+}
+
+bool MappedFile::IsStale() const {
+  struct stat status {};
+  if (stat(path_.c_str(), &status) != 0) {
+    return true;
+  }
+  return static_cast<uint64_t>(status.st_ino) != inode_ or
+         static_cast<size_t>(status.st_size) != size_ or
+         WriteTimeNs(status) != write_time_;
+}
+
+ResourceCache& ResourceCache::Instance() {
+  static ResourceCache cache;
+  return cache;
+}
+
+ResourceCache::~ResourceCache() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  prefetch_ready_.notify_all();
+  if (prefetch_thread_.joinable()) {
+    prefetch_thread_.join();
+  }
+}
+
+std::shared_ptr<const MappedFile> ResourceCache::Map(const std::string& path) {
+  const std::string key{std::filesystem::path{path}.lexically_normal()};
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    const auto found{entries_.find(key)};
+    if (found != entries_.end()) {
+      const auto entry{found->second};
+      if (not entry->file->IsStale()) {
+        lru_.splice(lru_.begin(), lru_, entry);
+        stats_.hits++;
+        return entry->file;
+      }
+      lru_.erase(entry);
+      entries_.erase(found);
+    }
+  }
+  // Mapped without the lock so that a prefetch does not hold up a load.
+  auto file{std::make_shared<const MappedFile>(key)};
+  const std::lock_guard<std::mutex> lock{mutex_};
+  stats_.maps++;
+  stats_.bytes_mapped += file->Size();
+  const auto found{entries_.find(key)};
+  if (found != entries_.end()) {
+    // Another thread mapped it meanwhile.
+    lru_.erase(found->second);
+    entries_.erase(found);
+  }
+  lru_.push_front(Entry{key, file});
+  entries_[key] = lru_.begin();
+  Evict();
+  return file;
+}
+
+std::shared_ptr<const MappedFile> ResourceCache::TryMap(
+    const std::string& path) {
+  try {
+    return Map(path);
+  } catch (const ResourceException&) {
+    return nullptr;
+  }
+}
+
+void ResourceCache::Prefetch(const std::string& path) {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    if (not prefetch_thread_.joinable()) {
+      prefetch_thread_ = std::thread{&ResourceCache::PrefetchLoop, this};
+    }
+    prefetch_queue_.push_back(path);
+  }
+  prefetch_ready_.notify_one();
+}
+
+void ResourceCache::PrefetchLoop() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    prefetch_ready_.wait(
+        lock, [this] { return stop_ or not prefetch_queue_.empty(); });
+    if (stop_) {
+      return;
+    }
+    const std::string path{std::move(prefetch_queue_.front())};
+    prefetch_queue_.pop_front();
+    lock.unlock();
+    const auto file{TryMap(path)};
+    if (file) {
+      file->Prefetch();
+    }
+    lock.lock();
+    if (file) {
+      stats_.prefetches++;
+    }
+  }
+}
+
+void ResourceCache::SetCapacity(size_t capacity) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  capacity_ = capacity;
+  Evict();
+}
+
+void ResourceCache::Evict() {
+  while (lru_.size() > capacity_) {
+    entries_.erase(lru_.back().path);
+    lru_.pop_back();
+    stats_.evictions++;
+  }
+}
+
+ResourceCacheStats ResourceCache::Stats() const {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  return stats_;
+}
+
+std::ostream& operator<<(std::ostream& out, const ResourceCache& cache) {
+  const ResourceCacheStats stats{cache.Stats()};
+  constexpr double kBytesPerKiB{1024.0};
+  out << "Resource cache: " << stats.maps << " files mapped ("
+      << std::fixed << std::setprecision(1)
+      << static_cast<double>(stats.bytes_mapped) / kBytesPerKiB << " KiB), "
+      << stats.hits << " hits, " << stats.evictions << " evictions, "
+      << stats.prefetches << " prefetched\n"
+      << std::defaultfloat;
+  return out;
+}
@@ -0,0 +1,149 @@
+#ifndef RESOURCECACHE_H_
+#define RESOURCECACHE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ResourceException : public std::runtime_error {
+ public:
+  explicit ResourceException(const std::string& msg)
+      : std::runtime_error(msg) {}
+};
+
+// A whole file mapped read-only with mmap. The views point into the page
+// cache, so reading a file copies nothing until the caller does. Reading a
+// mapped file that another process has truncated in place raises SIGBUS,
+// which an editor saving a shader during hot reload could do. Files of up
+// to kMaxCopySize bytes, which covers shader sources, are therefore read
+// into memory instead of mapped. Larger files must not be truncated in
+// place while the program runs; ResourceCache maps a file again when its
+// size changes, but a view that a caller still holds is not remapped.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class MappedFile {
+ public:
+  static constexpr size_t kMaxCopySize{64 * 1024};
+
+  // Throws ResourceException if the file cannot be opened or mapped.
+  explicit MappedFile(const std::string& path);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const std::string& Path() const { return path_; }
+
+  size_t Size() const { return size_; }
+
+  std::string_view Text() const {
+    return std::string_view{static_cast<const char*>(data_), size_};
+  }
+
+  std::span<const std::byte> Bytes() const {
+    return std::span<const std::byte>{static_cast<const std::byte*>(data_),
+                                      size_};
+  }
+
+  // Reads the file's pages into memory so that later reads do not wait
+  // for the disk. A copied file is in memory already.
+  void Prefetch() const;
+
+  // True if the file at Path() is no longer the one that was mapped: it
+  // was replaced, resized or written since.
+  bool IsStale() const;
+
+ private:
+  std::string path_;
+  void* data_{nullptr};
+  size_t size_{0};
+  // The contents of a small file; empty when the file is mapped.
+  std::vector<char> copy_;
+  uint64_t inode_{0};
+  // Nanoseconds.
+  int64_t write_time_{0};
+};
+
+struct ResourceCacheStats {
+  // Map calls answered by a mapping that was already open.
+  unsigned long hits{0};
+  // Files mapped, including files mapped again because they changed.
+  unsigned long maps{0};
+  unsigned long evictions{0};
+  unsigned long prefetches{0};
+  unsigned long bytes_mapped{0};
+};
+
+// Maps resource files, such as shaders, meshes and textures, and keeps the
+// most recently used mappings open, so loading a file again costs a stat
+// call. A mapping stays valid for as long as a caller holds it, even after
+// it has been evicted. Prefetch queues files for a worker thread that maps
+// them and reads their pages ahead, so an asset loader can ask for the
+// files it will need before it needs them.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class ResourceCache {
+ public:
+  static constexpr size_t kDefaultCapacity{64};
+
+  static ResourceCache& Instance();
+
+  ~ResourceCache();
+
+  ResourceCache(const ResourceCache&) = delete;
+  ResourceCache& operator=(const ResourceCache&) = delete;
+
+  // Throws ResourceException if the file cannot be opened or mapped.
+  std::shared_ptr<const MappedFile> Map(const std::string& path);
+
+  // Returns nullptr instead of throwing.
+  std::shared_ptr<const MappedFile> TryMap(const std::string& path);
+
+  // Maps path and reads it into memory on the worker thread. Files that
+  // cannot be mapped are ignored.
+  void Prefetch(const std::string& path);
+
+  // The number of mappings kept open.
+  void SetCapacity(size_t capacity);
+
+  ResourceCacheStats Stats() const;
+
+ private:
+  struct Entry {
+    std::string path;
+    std::shared_ptr<const MappedFile> file;
+  };
+
+  ResourceCache() = default;
+
+  void PrefetchLoop();
+
+  void Evict();
+
+  mutable std::mutex mutex_;
+  size_t capacity_{kDefaultCapacity};
+  // Most recently used first.
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+  ResourceCacheStats stats_;
+
+  std::deque<std::string> prefetch_queue_;
+  std::condition_variable prefetch_ready_;
+  bool stop_{false};
+  std::thread prefetch_thread_;
+};
+
+std::ostream& operator<<(std::ostream& out, const ResourceCache& cache);
+
+#endif
@@ -2,14 +2,32 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include <atomic>
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "hid.h"
 
 class GLFWApp;
 
+// Immutable state handed from the update thread to the render thread when
+// GLFWApp renders on its own thread. Scenes whose Draw reads state that
+// Update changes derive from this and copy that state in Snapshot, so
+// that DrawSnapshot reads only the copy.
+class SceneSnapshot {
+ public:
+  SceneSnapshot(double time, double interpolation_alpha)
+      : time{time}, interpolation_alpha{interpolation_alpha} {}
+  virtual ~SceneSnapshot() = default;
+
+  // NOLINTBEGIN(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
+  const double time;
+  const double interpolation_alpha;
+  // NOLINTEND(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
+};
+
 class SceneException : public std::runtime_error {
  public:
   explicit SceneException(const std::string& msg) : std::runtime_error(msg) {}
@@ -30,18 +48,43 @@ class Scene {
 
   virtual ~Scene() = default;
 
+  // Create the scene's shareable GL objects: load and link shader programs,
+  // fill buffers and upload textures. GLFWApp calls Prepare once, before the
+  // first Begin, and may call it ahead of time on a loader thread whose
+  // context shares objects with the drawing context. Prepare must not create
+  // vertex arrays or framebuffers, which are not shared, or rely on context
+  // state such as bindings; Begin does that.
+  virtual bool Prepare() { return true; }
+
+  // The files Prepare reads, such as shader sources. SceneLoader reads them
+  // ahead on the ResourceCache's worker while the previous scene draws.
+  virtual std::vector<std::string> Resources() const { return {}; }
+
   // Initialization
   virtual bool Begin() = 0;
 
   // Clean up
   virtual bool End() = 0;
 
-  // Update the scene, called prior to redrawing
+  // Update the scene, called prior to redrawing. With a fixed timestep this
+  // is called once per tick and time advances by TickDelta() per call.
   virtual bool Update(double time) = 0;
 
-  // Draw the scene
+  // Draw the scene. With a fixed timestep, InterpolationAlpha() is the
+  // fraction of a tick that has elapsed since the last Update; blend the
+  // previous and current simulation state by it.
   virtual bool Draw(double time) = 0;
 
+  // With a render thread, Update and Snapshot run on the main thread and
+  // must not call OpenGL; Begin, DrawSnapshot, Resize and End run on the
+  // render thread, at the same time as Update. Every scene decides what
+  // its snapshot holds, since only it knows what Draw reads.
+  virtual std::shared_ptr<const SceneSnapshot> Snapshot(double time) = 0;
+
+  // Draw from a snapshot on the render thread. Must not read anything
+  // that Update changes except through the snapshot.
+  virtual bool DrawSnapshot(const SceneSnapshot& snapshot) = 0;
+
   // Resize
   virtual bool Resize(size_t width, size_t height) = 0;
 
@@ -60,6 +103,20 @@ class Scene {
     this->height = height;
   }
 
+  void SetTimestep(double tick_delta, double interpolation_alpha) {
+    this->tick_delta = tick_delta;
+    this->interpolation_alpha = interpolation_alpha;
+  }
+
+  // Zero when Update runs once per frame.
+  double TickDelta() const { return tick_delta; }
+
+  double InterpolationAlpha() const { return interpolation_alpha; }
+
+  bool IsPrepared() const { return prepared; }
+
+  void SetPrepared(bool prepared) { this->prepared = prepared; }
+
   void ToggleAnimation() { animate_on = !animate_on; }
 
   bool IsAnimated() const { return animate_on; }
@@ -85,8 +142,13 @@ class Scene {
   glm::mat4 model;
   glm::mat4 view;
   glm::mat4 projection;
+
+  double tick_delta{0.0};
+  double interpolation_alpha{1.0};
   // NOLINTEND(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
   bool is_valid;
+  // Set by the loader thread.
+  std::atomic<bool> prepared{false};
 };
 
 inline std::ostream& operator<<(std::ostream& out, const Scene& scene) {
@@ -104,6 +166,8 @@ class SceneManager {
   virtual std::shared_ptr<Scene> First() { return nullptr; }
   virtual std::shared_ptr<Scene> At(unsigned int index) { return nullptr; }
   virtual std::shared_ptr<Scene> Next() { return nullptr; }
+  // The scene Next will return, without moving to it.
+  virtual std::shared_ptr<Scene> PeekNext() { return nullptr; }
   virtual unsigned int Size() { return 0; }
 };
 
@@ -133,6 +197,12 @@ class CircularQueueSceneManager : public SceneManager {
     scene->Validate();
     return scene;
   }
+  std::shared_ptr<Scene> PeekNext() override {
+    if (scenes_.empty()) {
+      return nullptr;
+    }
+    return scenes_.at((scene_index_ + 1L) % scenes_.size());
+  }
   unsigned int Size() override { return scenes_.size(); }
 
  private:
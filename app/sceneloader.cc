@@ -0,0 +1,118 @@
+
+#include "sceneloader.h"
+
+#include <algorithm>
+
+#include "glfwapp.h"
+#include "glstate.h"
+#include "resourcecache.h"
+
+SceneLoader::SceneLoader(GLFWwindow* share) {
+  // Asks for the context the drawing window got, so that the two are
+  // compatible whatever hints are current.
+  glfwDefaultWindowHints();
+  for (const int hint :
+       {GLFW_CONTEXT_CREATION_API, GLFW_CONTEXT_VERSION_MAJOR,
+        GLFW_CONTEXT_VERSION_MINOR, GLFW_OPENGL_FORWARD_COMPAT,
+        GLFW_OPENGL_PROFILE, GLFW_OPENGL_DEBUG_CONTEXT,
+        GLFW_CONTEXT_NO_ERROR}) {
+    glfwWindowHint(hint, glfwGetWindowAttrib(share, hint));
+  }
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  window_ = glfwCreateWindow(1, 1, "Scene Loader", nullptr, share);
+  // Windows made later get the defaults, not an invisible window.
+  glfwDefaultWindowHints();
+  if (window_ == nullptr) {
+    throw GLFWAppException("Could not create the scene loader's context.");
+  }
+  loader_ = std::thread{&SceneLoader::LoaderLoop, this};
+}
+
+SceneLoader::~SceneLoader() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  wake_.notify_one();
+  loader_.join();
+  for (auto& [scene, done] : pending_) {
+    if (done.valid() and
+        done.wait_for(std::chrono::seconds{0}) == std::future_status::ready) {
+      try {
+        glDeleteSync(done.get());
+      } catch (...) {
+        // The scene is not going to be drawn.
+      }
+    }
+  }
+  glfwDestroyWindow(window_);
+}
+
+void SceneLoader::Prepare(const std::shared_ptr<Scene>& scene) {
+  if (not scene or scene->IsPrepared()) {
+    return;
+  }
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    const bool queued{std::any_of(
+        pending_.begin(), pending_.end(),
+        [&](const auto& pending) { return pending.first == scene.get(); })};
+    if (queued) {
+      return;
+    }
+    for (const std::string& path : scene->Resources()) {
+      ResourceCache::Instance().Prefetch(path);
+    }
+    Job job{scene, std::promise<GLsync>{}};
+    pending_.emplace_back(scene.get(), job.done.get_future());
+    queue_.push_back(std::move(job));
+  }
+  wake_.notify_one();
+}
+
+bool SceneLoader::Wait(const std::shared_ptr<Scene>& scene) {
+  std::future<GLsync> done;
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    auto found{std::find_if(
+        pending_.begin(), pending_.end(),
+        [&](const auto& pending) { return pending.first == scene.get(); })};
+    if (found == pending_.end()) {
+      return false;
+    }
+    done = std::move(found->second);
+    pending_.erase(found);
+  }
+  GLsync fence{done.get()};
+  // The GPU, not this thread, waits for the loader's commands to finish.
+  glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence);
+  return true;
+}
+
+void SceneLoader::LoaderLoop() {
+  glfwMakeContextCurrent(window_);
+  GLStateCache::Current().Invalidate();
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    wake_.wait(lock, [&] { return stop_ or not queue_.empty(); });
+    if (stop_) {
+      break;
+    }
+    Job job{std::move(queue_.front())};
+    queue_.pop_front();
+    lock.unlock();
+    try {
+      job.scene->Prepare();
+      job.scene->SetPrepared(true);
+      GLsync fence{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+      // Without a flush the fence might never reach the GPU.
+      glFlush();
+      job.done.set_value(fence);
+    } catch (...) {
+      job.done.set_exception(std::current_exception());
+    }
+    lock.lock();
+  }
+  glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,63 @@
+#ifndef SCENELOADER_H_
+#define SCENELOADER_H_
+
+#include "glad/gl.h"
+
+#include <GLFW/glfw3.h>
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "scene.h"
+
+// Runs Scene::Prepare on a loader thread so that switching scenes does not
+// stall drawing while shaders compile and buffers fill. The loader thread
+// owns a hidden window whose context shares objects with the drawing
+// context. When Prepare returns, the loader inserts a fence; Wait makes the
+// drawing context wait on it so the objects are complete before they are
+// used.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class SceneLoader {
+ public:
+  // Creates the loader's window, so it must be called on the main thread.
+  explicit SceneLoader(GLFWwindow* share);
+
+  // Finishes the scene being prepared and drops the rest.
+  ~SceneLoader();
+
+  SceneLoader(const SceneLoader&) = delete;
+  SceneLoader& operator=(const SceneLoader&) = delete;
+
+  // Queues the scene unless it is prepared or already queued, and has the
+  // ResourceCache read its Resources ahead.
+  void Prepare(const std::shared_ptr<Scene>& scene);
+
+  // Call on the drawing thread before the scene's Begin. Blocks until a
+  // queued Prepare of the scene is done and rethrows what it threw. Returns
+  // false when the scene was never queued.
+  bool Wait(const std::shared_ptr<Scene>& scene);
+
+ private:
+  struct Job {
+    std::shared_ptr<Scene> scene;
+    std::promise<GLsync> done;
+  };
+
+  void LoaderLoop();
+
+  GLFWwindow* window_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Job> queue_;
+  std::vector<std::pair<Scene*, std::future<GLsync>>> pending_;
+  bool stop_{false};
+  std::thread loader_;
+};
+
+#endif
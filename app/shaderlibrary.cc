@@ -0,0 +1,380 @@
+
+#include "shaderlibrary.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+#include "hotreload.h"
+#include "msutil.h"
+#include "resourcecache.h"
+
+namespace {
+
+// Removes the spaces and tabs at the start of text.
+std::string_view TrimBlanks(std::string_view text) {
+  while (not text.empty() and (text.front() == ' ' or text.front() == '\t')) {
+    text.remove_prefix(1);
+  }
+  return text;
+}
+
+// Returns the name of the preprocessor directive on line, such as
+// "include", and leaves its arguments in line; returns an empty view if
+// line is not a directive.
+std::string_view Directive(std::string_view& line) {
+  line = TrimBlanks(line);
+  if (not line.starts_with('#')) {
+    return {};
+  }
+  line = TrimBlanks(line.substr(1));
+  size_t end{0};
+  while (end < line.size() and
+         std::isalpha(static_cast<unsigned char>(line[end])) != 0) {
+    end++;
+  }
+  const std::string_view name{line.substr(0, end)};
+  line = TrimBlanks(line.substr(end));
+  return name;
+}
+
+// Returns the file name of an #include "file" or #include <file> line, or
+// an empty view if line is not an #include.
+std::string_view IncludedFile(std::string_view line) {
+  if (Directive(line) != "include") {
+    return {};
+  }
+  if (line.empty() or (line.front() != '"' and line.front() != '<')) {
+    return {};
+  }
+  const char close{line.front() == '"' ? '"' : '>'};
+  line.remove_prefix(1);
+  const size_t end{line.find(close)};
+  return end == std::string_view::npos ? std::string_view{}
+                                       : line.substr(0, end);
+}
+
+// Returns whether a /* comment is open at the end of line, given whether
+// one was open at its start.
+bool EndsInComment(std::string_view line, bool in_comment) {
+  for (size_t i{0}; i + 1 < line.size(); i++) {
+    if (in_comment) {
+      if (line[i] == '*' and line[i + 1] == '/') {
+        in_comment = false;
+        i++;
+      }
+    } else if (line[i] == '/' and line[i + 1] == '/') {
+      break;
+    } else if (line[i] == '/' and line[i + 1] == '*') {
+      in_comment = true;
+      i++;
+    }
+  }
+  return in_comment;
+}
+
+// Tracks #if 0 blocks: returns the nesting depth inside the outermost
+// disabled block after line, given the depth before it (0 if enabled).
+int DisabledDepth(std::string_view line, int depth) {
+  const std::string_view name{Directive(line)};
+  if (depth == 0) {
+    const bool zero{line.starts_with('0') and
+                    (line.size() == 1 or
+                     std::isalnum(static_cast<unsigned char>(line[1])) == 0)};
+    return name == "if" and zero ? 1 : 0;
+  }
+  if (name == "if" or name == "ifdef" or name == "ifndef") {
+    return depth + 1;
+  }
+  if (name == "endif") {
+    return depth - 1;
+  }
+  if (depth == 1 and (name == "else" or name == "elif")) {
+    return 0;
+  }
+  return depth;
+}
+
+// SPIR-V opcodes and decorations used to find specialization constants.
+constexpr uint32_t kSpirvMagic{0x07230203};
+constexpr size_t kSpirvHeaderWords{5};
+constexpr uint32_t kOpName{5};
+constexpr uint32_t kOpDecorate{71};
+constexpr uint32_t kDecorationSpecId{1};
+
+// Maps the names of the specialization constants in spirv to their ids.
+std::unordered_map<std::string, GLuint> SpecializationIds(
+    std::string_view spirv) {
+  std::unordered_map<uint32_t, std::string> names;
+  std::unordered_map<uint32_t, GLuint> spec_ids;
+  std::vector<uint32_t> words(spirv.size() / sizeof(uint32_t));
+  std::memcpy(words.data(), spirv.data(), words.size() * sizeof(uint32_t));
+  if (words.size() < kSpirvHeaderWords or words[0] != kSpirvMagic) {
+    return {};
+  }
+  for (size_t at = kSpirvHeaderWords; at < words.size();) {
+    const uint32_t opcode{words[at] & 0xFFFF};
+    const uint32_t count{words[at] >> 16};
+    if (count == 0 or at + count > words.size()) {
+      break;
+    }
+    if (opcode == kOpName and count > 2) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      const auto* name{reinterpret_cast<const char*>(&words[at + 2])};
+      names[words[at + 1]] =
+          std::string{name, strnlen(name, (count - 2) * sizeof(uint32_t))};
+    } else if (opcode == kOpDecorate and count == 4 and
+               words[at + 2] == kDecorationSpecId) {
+      spec_ids[words[at + 1]] = words[at + 3];
+    }
+    at += count;
+  }
+  std::unordered_map<std::string, GLuint> ids;
+  for (const auto& [id, spec_id] : spec_ids) {
+    const auto name{names.find(id)};
+    if (name != names.end()) {
+      ids[name->second] = spec_id;
+    }
+  }
+  return ids;
+}
+
+// The 32 bits SPIR-V stores for a constant's value.
+GLuint SpecializationValue(const std::string& value) {
+  if (value.empty() or value == "true") {
+    return 1;
+  }
+  if (value == "false") {
+    return 0;
+  }
+  if (value.find('.') != std::string::npos) {
+    return std::bit_cast<GLuint>(std::strtof(value.c_str(), nullptr));
+  }
+  return static_cast<GLuint>(std::strtol(value.c_str(), nullptr, 0));
+}
+
+}  // namespace
+
+ShaderLibrary& ShaderLibrary::Instance() {
+  static ShaderLibrary library;
+  return library;
+}
+
+void ShaderLibrary::AddIncludeDirectory(const std::string& directory) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  include_directories_.push_back(directory);
+}
+
+ShaderSource ShaderLibrary::Load(const std::string& path,
+                                 const std::vector<std::string>& defines) {
+  ShaderSource source;
+  Include(FileWatcher::Normalize(path), source);
+  if (defines.empty()) {
+    return source;
+  }
+  // The defines go after #version, which must come first.
+  std::string define_lines;
+  for (const std::string& define : defines) {
+    const size_t equals{define.find('=')};
+    define_lines += "#define " + define.substr(0, equals);
+    if (equals != std::string::npos) {
+      define_lines += " " + define.substr(equals + 1);
+    }
+    define_lines += "\n";
+  }
+  const size_t version{source.text.find("#version")};
+  if (version == std::string::npos) {
+    source.text.insert(0, define_lines + "#line 1 0\n");
+  } else {
+    const size_t end{source.text.find('\n', version)};
+    const size_t line{
+        static_cast<size_t>(std::count(source.text.begin(),
+                                       source.text.begin() + version, '\n')) +
+        2};
+    source.text.insert(end == std::string::npos ? source.text.size() : end + 1,
+                       define_lines + "#line " + std::to_string(line) +
+                           " 0\n");
+  }
+  return source;
+}
+
+void ShaderLibrary::Include(const std::string& path, ShaderSource& source) {
+  if (std::find(source.files.begin(), source.files.end(), path) !=
+      source.files.end()) {
+    return;
+  }
+  const size_t index{source.files.size()};
+  source.files.push_back(path);
+  // Lines are copied from the mapping straight into the output.
+  const auto file{ResourceCache::Instance().TryMap(path)};
+  if (not file) {
+    throw GLSLException("Could not open and load shader source path " + path +
+                        ".\n");
+  }
+  std::string_view text{file->Text()};
+  const std::filesystem::path directory{
+      std::filesystem::path{path}.parent_path()};
+  size_t line_number{0};
+  // #include lines in comments and #if 0 blocks are copied unexpanded.
+  bool in_comment{false};
+  int disabled_depth{0};
+  while (not text.empty()) {
+    const size_t end{text.find('\n')};
+    const std::string_view line{text.substr(0, end)};
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    line_number++;
+    const bool commented{in_comment};
+    in_comment = EndsInComment(line, in_comment);
+    bool disabled{true};
+    if (not commented) {
+      disabled = disabled_depth != 0;
+      disabled_depth = DisabledDepth(line, disabled_depth);
+    }
+    const std::string_view included{disabled ? std::string_view{}
+                                             : IncludedFile(line)};
+    if (included.empty()) {
+      source.text += line;
+      source.text += '\n';
+      continue;
+    }
+    std::string included_path{
+        FileWatcher::Normalize((directory / included).string())};
+    if (not std::filesystem::exists(included_path)) {
+      const std::lock_guard<std::mutex> lock{mutex_};
+      for (const std::string& include_directory : include_directories_) {
+        const std::filesystem::path candidate{
+            std::filesystem::path{include_directory} / included};
+        if (std::filesystem::exists(candidate)) {
+          included_path = FileWatcher::Normalize(candidate.string());
+          break;
+        }
+      }
+    }
+    if (std::find(source.files.begin(), source.files.end(), included_path) !=
+        source.files.end()) {
+      // Keeps the line count of this file.
+      source.text += '\n';
+      continue;
+    }
+    source.text += "#line 1 " + std::to_string(source.files.size()) + "\n";
+    Include(included_path, source);
+    source.text += "#line " + std::to_string(line_number + 1) + " " +
+                   std::to_string(index) + "\n";
+  }
+}
+
+bool ShaderLibrary::SupportsSpirv() const {
+  return spirv_enabled_ and
+         (GLAD_GL_VERSION_4_6 != 0 or GLAD_GL_ARB_gl_spirv != 0);
+}
+
+bool ShaderLibrary::LoadSpirv(const std::string& path,
+                              const std::vector<std::string>& defines,
+                              ShaderSource& source) {
+  if (not SupportsSpirv()) {
+    return false;
+  }
+  const std::filesystem::path glsl_path{path};
+  std::filesystem::path spirv_path{glsl_path.parent_path() / "spirv" /
+                                   glsl_path.filename()};
+  spirv_path.replace_extension(".spv");
+  std::error_code error;
+  const auto spirv_time{std::filesystem::last_write_time(spirv_path, error)};
+  if (error) {
+    return false;
+  }
+  // The binary is stale if the source or any file it includes is newer,
+  // so the includes are found as the GLSL path finds them.
+  ShaderSource glsl;
+  try {
+    Include(FileWatcher::Normalize(path), glsl);
+  } catch (const GLSLException&) {
+    return false;
+  }
+  for (const std::string& file : glsl.files) {
+    const auto file_time{std::filesystem::last_write_time(file, error)};
+    if (error or spirv_time < file_time) {
+      return false;
+    }
+  }
+  const auto file{ResourceCache::Instance().TryMap(spirv_path)};
+  if (not file or file->Size() == 0 or
+      file->Size() % sizeof(uint32_t) != 0) {
+    return false;
+  }
+  const std::string_view binary{file->Text()};
+  std::vector<SpecializationConstant> constants;
+  if (not defines.empty()) {
+    const auto ids{SpecializationIds(binary)};
+    for (const std::string& define : defines) {
+      const size_t equals{define.find('=')};
+      const auto id{ids.find(define.substr(0, equals))};
+      if (id == ids.end()) {
+        return false;
+      }
+      constants.push_back(SpecializationConstant{
+          id->second, SpecializationValue(equals == std::string::npos
+                                              ? std::string{}
+                                              : define.substr(equals + 1))});
+    }
+  }
+  source.text.assign(binary);
+  // Edits to the GLSL and its includes are what hot reload watches.
+  source.files = std::move(glsl.files);
+  source.spirv = true;
+  source.constants = std::move(constants);
+  return true;
+}
+
+std::shared_ptr<Shader> ShaderLibrary::Stage(shader_t type,
+                                             const std::string& path,
+                                             const ShaderSource& source) {
+  uint64_t key{ms_util::Fnv1a64(std::to_string(type))};
+  key = ms_util::Fnv1a64(source.spirv ? "spirv" : "glsl", key);
+  key = ms_util::Fnv1a64(source.text, key);
+  for (const SpecializationConstant& constant : source.constants) {
+    key = ms_util::Fnv1a64(std::to_string(constant.id) + "=" +
+                               std::to_string(constant.value) + ";",
+                           key);
+  }
+  const std::lock_guard<std::mutex> lock{mutex_};
+  stats_.requests++;
+  std::shared_ptr<Shader> stage;
+  const auto found{stages_.find(key)};
+  if (found != stages_.end()) {
+    stage = found->second.lock();
+    if (not stage) {
+      stages_.erase(found);
+    }
+  }
+  if (not stage) {
+    // Only submitted; a program checks its stages when it is linked.
+    if (source.spirv) {
+      stage = std::make_shared<Shader>(path, type, source.text,
+                                       source.constants, false);
+      stats_.spirv++;
+    } else {
+      stage = std::make_shared<Shader>(path, type, source.text, false);
+    }
+    stages_.emplace(key, stage);
+    stats_.compiled++;
+  }
+  return stage;
+}
+
+ShaderLibraryStats ShaderLibrary::Stats() const {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  return stats_;
+}
+
+std::ostream& operator<<(std::ostream& out, const ShaderLibrary& library) {
+  const ShaderLibraryStats stats{library.Stats()};
+  out << "Shader library: " << stats.requests << " stages requested, "
+      << stats.compiled << " compiled (" << stats.spirv << " from SPIR-V), "
+      << (stats.requests - stats.compiled) << " shared\n";
+  return out;
+}
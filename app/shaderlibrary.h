@@ -0,0 +1,83 @@
+#ifndef SHADERLIBRARY_H_
+#define SHADERLIBRARY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glslshader.h"
+
+struct ShaderLibraryStats {
+  // Stages asked for.
+  unsigned long requests{0};
+  // Stages that were compiled; the others were shared.
+  unsigned long compiled{0};
+  // Compiled stages that were loaded from SPIR-V.
+  unsigned long spirv{0};
+};
+
+// Builds shader stages from files with #include "file" directives and a
+// list of macros, and shares compiled stages between programs. Stages are
+// found by a hash of their type and preprocessed source, so a set of
+// variants compiles each distinct stage once, however many programs use
+// it. A stage is deleted when the last program using it is.
+//
+// When the context supports SPIR-V (OpenGL 4.6 or ARB_gl_spirv), stages
+// built offline with `make spirv` can be loaded in place of their GLSL
+// text, and defines set the shaders' specialization constants. Programs
+// ask for that with SpirvUse::kIfBuilt.
+class ShaderLibrary {
+ public:
+  static ShaderLibrary& Instance();
+
+  // Searched after the including file's directory.
+  void AddIncludeDirectory(const std::string& directory);
+
+  // Reads path and the files it includes, each at most once, and puts a
+  // #define for each of defines after the #version line. A define is a
+  // name or name=value. Throws GLSLException if a file cannot be read.
+  ShaderSource Load(const std::string& path,
+                    const std::vector<std::string>& defines = {});
+
+  // Looks for the SPIR-V that `make spirv` built from path: for
+  // shaders/name.glsl, shaders/spirv/name.spv. Each define, name=value,
+  // sets the specialization constant of that name; a value is true, false,
+  // an integer, or a float if it has a decimal point. Returns false, and
+  // the GLSL text should be used, if SPIR-V is disabled or unsupported,
+  // the binary is missing or older than path or a file it includes, or a
+  // define names no specialization constant.
+  bool LoadSpirv(const std::string& path,
+                 const std::vector<std::string>& defines, ShaderSource& source);
+
+  // Needs a current context.
+  bool SupportsSpirv() const;
+
+  void SetSpirvEnabled(bool enabled) { spirv_enabled_ = enabled; }
+
+  // Returns the compiled stage for source, submitting a compile if no
+  // live stage has the same source. path is only used in messages.
+  std::shared_ptr<Shader> Stage(shader_t type, const std::string& path,
+                                const ShaderSource& source);
+
+  ShaderLibraryStats Stats() const;
+
+ private:
+  ShaderLibrary() = default;
+
+  void Include(const std::string& path, ShaderSource& source);
+
+  std::vector<std::string> include_directories_;
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, std::weak_ptr<Shader>> stages_;
+  std::atomic<bool> spirv_enabled_{true};
+  ShaderLibraryStats stats_;
+};
+
+std::ostream& operator<<(std::ostream& out, const ShaderLibrary& library);
+
+#endif
@@ -0,0 +1,157 @@
+
+#include "streambuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+
+#include "glstate.h"
+#include "msutil.h"
+
+namespace {
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+std::mutex g_totals_mutex;
+StreamBufferStats g_totals;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+}  // namespace
+
+StreamBuffer::StreamBuffer(GLenum target, size_t bytes_per_frame,
+                           size_t alignment, unsigned int frames_in_flight)
+    : target_{target},
+      alignment_{std::max<size_t>(alignment, 1)},
+      fences_(frames_in_flight, nullptr) {
+  if (frames_in_flight == 0) {
+    throw StreamBufferException(
+        "A stream buffer needs at least one frame in flight.");
+  }
+  region_size_ = ms_util::RoundUp(bytes_per_frame, alignment_);
+  const auto buffer_size{
+      static_cast<GLsizeiptr>(region_size_ * frames_in_flight)};
+  glGenBuffers(1, &buffer_);
+  GLStateCache::Current().BindBuffer(target_, buffer_);
+  persistent_ = GLAD_GL_VERSION_4_4 != 0 or GLAD_GL_ARB_buffer_storage != 0;
+  if (persistent_) {
+    const GLbitfield flags{GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                           GL_MAP_COHERENT_BIT};
+    glBufferStorage(target_, buffer_size, nullptr, flags);
+    mapped_ = static_cast<std::byte*>(
+        glMapBufferRange(target_, 0, buffer_size, flags));
+    if (mapped_ == nullptr) {
+      // The destructor does not run for a constructor that throws.
+      GLStateCache::Current().ForgetBuffer(buffer_);
+      glDeleteBuffers(1, &buffer_);
+      throw StreamBufferException("Could not map the stream buffer.");
+    }
+  } else {
+    glBufferData(target_, buffer_size, nullptr, GL_STREAM_DRAW);
+    staging_.resize(region_size_);
+  }
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync fence : fences_) {
+    if (fence != nullptr) {
+      glDeleteSync(fence);
+    }
+  }
+  if (mapped_ != nullptr) {
+    GLStateCache::Current().BindBuffer(target_, buffer_);
+    glUnmapBuffer(target_);
+  }
+  GLStateCache::Current().ForgetBuffer(buffer_);
+  glDeleteBuffers(1, &buffer_);
+}
+
+void StreamBuffer::BeginFrame() {
+  region_ = (region_ + 1) % fences_.size();
+  head_ = 0;
+  uploaded_ = 0;
+  GLsync& fence{fences_[region_]};
+  if (fence == nullptr) {
+    return;
+  }
+  GLenum status{glClientWaitSync(fence, 0, 0)};
+  if (status == GL_TIMEOUT_EXPIRED) {
+    stats_.waits++;
+    const auto start{std::chrono::steady_clock::now()};
+    constexpr GLuint64 kOneSecondNs{1000000000};
+    do {
+      status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                kOneSecondNs);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    stats_.wait_ms += std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+StreamRange StreamBuffer::Allocate(size_t size, size_t alignment) {
+  const size_t offset{
+      ms_util::RoundUp(head_, alignment == 0 ? alignment_ : alignment)};
+  if (offset + size > region_size_) {
+    throw StreamBufferException("The stream buffer's " +
+                                std::to_string(region_size_) +
+                                " bytes per frame are used up.");
+  }
+  head_ = offset + size;
+  stats_.allocations++;
+  stats_.bytes += size;
+  std::byte* data{persistent_ ? mapped_ + region_ * region_size_ + offset
+                              : staging_.data() + offset};
+  return StreamRange{data,
+                     static_cast<GLintptr>(region_ * region_size_ + offset),
+                     static_cast<GLsizeiptr>(size)};
+}
+
+void StreamBuffer::Flush() {
+  if (persistent_ or uploaded_ == head_) {
+    return;
+  }
+  GLStateCache::Current().BindBuffer(target_, buffer_);
+  glBufferSubData(target_,
+                  static_cast<GLintptr>(region_ * region_size_ + uploaded_),
+                  static_cast<GLsizeiptr>(head_ - uploaded_),
+                  staging_.data() + uploaded_);
+  uploaded_ = head_;
+}
+
+void StreamBuffer::EndFrame() {
+  GLsync& fence{fences_[region_]};
+  if (fence != nullptr) {
+    glDeleteSync(fence);
+  }
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // The frame's share of the totals.
+  const std::lock_guard<std::mutex> lock{g_totals_mutex};
+  g_totals.frames++;
+  stats_.frames++;
+  g_totals.allocations += stats_.allocations - reported_.allocations;
+  g_totals.bytes += stats_.bytes - reported_.bytes;
+  g_totals.waits += stats_.waits - reported_.waits;
+  g_totals.wait_ms += stats_.wait_ms - reported_.wait_ms;
+  reported_ = stats_;
+}
+
+StreamBufferStats StreamBuffer::TotalStats() {
+  const std::lock_guard<std::mutex> lock{g_totals_mutex};
+  return g_totals;
+}
+
+std::ostream& operator<<(std::ostream& out, const StreamBufferStats& stats) {
+  out << stats.frames << " frames, " << stats.allocations << " allocations, "
+      << stats.bytes << " bytes, " << stats.waits << " waits, " << std::fixed
+      << std::setprecision(3) << stats.wait_ms << " ms waiting"
+      << std::defaultfloat;
+  return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const StreamBuffer& buffer) {
+  out << "Stream buffer (" << (buffer.IsPersistent() ? "persistent" : "copied")
+      << "): " << buffer.Stats() << "\n";
+  return out;
+}
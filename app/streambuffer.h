@@ -0,0 +1,130 @@
+#ifndef STREAMBUFFER_H_
+#define STREAMBUFFER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "glad/gl.h"
+
+class StreamBufferException : public std::runtime_error {
+ public:
+  explicit StreamBufferException(const std::string& message)
+      : std::runtime_error(message) {}
+};
+
+// Where an allocation was made in a StreamBuffer: the memory to write and
+// the offset to bind or draw from.
+struct StreamRange {
+  std::byte* data{nullptr};
+  GLintptr offset{0};
+  GLsizeiptr size{0};
+
+  // The range as an array of T, for example instance transforms.
+  template <typename T>
+  std::span<T> As() const {
+    static_assert(std::is_trivially_copyable_v<T>);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return std::span<T>{reinterpret_cast<T*>(data),
+                        static_cast<size_t>(size) / sizeof(T)};
+  }
+};
+
+struct StreamBufferStats {
+  unsigned long frames{0};
+  unsigned long allocations{0};
+  unsigned long bytes{0};
+  // Frames that had to wait for the GPU to finish with their region.
+  unsigned long waits{0};
+  double wait_ms{0.0};
+};
+
+// A buffer for data that changes every frame, such as uniform blocks,
+// transforms, particles and UI vertices. The buffer is split into one
+// region per frame in flight, and a frame sub-allocates aligned ranges one
+// after another from its region. A fence at the end of each frame keeps a
+// region from being overwritten while the GPU may still read it, so
+// writing never stalls on a buffer the GPU is using, unless the CPU is
+// frames_in_flight frames ahead.
+//
+// With OpenGL 4.4 or ARB_buffer_storage the buffer is mapped once,
+// persistently and coherently, and ranges point straight into it, so data
+// is written where the GPU reads it with no copies. Otherwise ranges point
+// into memory that Flush uploads with one glBufferSubData.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class StreamBuffer {
+ public:
+  static constexpr unsigned int kDefaultFramesInFlight{3};
+
+  // Needs a current context. alignment is the default for Allocate. Throws
+  // a StreamBufferException when frames_in_flight is 0.
+  StreamBuffer(GLenum target, size_t bytes_per_frame, size_t alignment,
+               unsigned int frames_in_flight = kDefaultFramesInFlight);
+
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // Call before the frame's first Allocate. Waits if the GPU is still
+  // reading this frame's region from frames_in_flight frames ago.
+  void BeginFrame();
+
+  // Reserves size bytes at a multiple of alignment, or of the buffer's
+  // alignment if it is 0. Throws a StreamBufferException when the frame's
+  // region is full.
+  StreamRange Allocate(size_t size, size_t alignment = 0);
+
+  template <typename T>
+  std::span<T> Allocate(size_t count, StreamRange& range) {
+    range = Allocate(count * sizeof(T), std::max(alignment_, alignof(T)));
+    return range.template As<T>();
+  }
+
+  // Uploads what the frame has written since the last Flush when the
+  // buffer is not mapped. Call before the draws that read it.
+  void Flush();
+
+  // Call after the frame's last draw that reads the buffer.
+  void EndFrame();
+
+  GLuint Id() const { return buffer_; }
+
+  GLenum Target() const { return target_; }
+
+  bool IsPersistent() const { return persistent_; }
+
+  const StreamBufferStats& Stats() const { return stats_; }
+
+  // The counters of every stream buffer so far, summed; frames counts
+  // each buffer's frames.
+  static StreamBufferStats TotalStats();
+
+ private:
+  GLenum target_;
+  GLuint buffer_{0};
+  bool persistent_{false};
+  std::byte* mapped_{nullptr};
+  // Data written before it is uploaded when the buffer is not mapped.
+  std::vector<std::byte> staging_;
+  size_t alignment_{0};
+  size_t region_size_{0};
+  std::vector<GLsync> fences_;
+  unsigned int region_{0};
+  size_t head_{0};
+  size_t uploaded_{0};
+  StreamBufferStats stats_;
+  // What EndFrame has added to the totals.
+  StreamBufferStats reported_;
+};
+
+std::ostream& operator<<(std::ostream& out, const StreamBufferStats& stats);
+
+std::ostream& operator<<(std::ostream& out, const StreamBuffer& buffer);
+
+#endif
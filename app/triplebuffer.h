@@ -0,0 +1,50 @@
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands values from one writer thread to one reader thread without locks.
+// The writer fills Back() and calls Publish(); the reader calls Update() and
+// then reads Front(). Neither side ever waits for the other, and the reader
+// always sees the most recently published value.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+
+  // Writer side.
+  T& Back() { return slots_[back_]; }
+
+  void Publish() {
+    const uint8_t previous{
+        middle_.exchange(back_ | kFreshBit, std::memory_order_acq_rel)};
+    back_ = previous & kIndexMask;
+  }
+
+  // Reader side. Returns true when a value was published since the last
+  // call.
+  bool Update() {
+    if ((middle_.load(std::memory_order_relaxed) & kFreshBit) == 0) {
+      return false;
+    }
+    const uint8_t previous{
+        middle_.exchange(front_, std::memory_order_acq_rel)};
+    front_ = previous & kIndexMask;
+    return true;
+  }
+
+  const T& Front() const { return slots_[front_]; }
+
+ private:
+  static constexpr uint8_t kIndexMask{0x3};
+  static constexpr uint8_t kFreshBit{0x4};
+
+  std::array<T, 3> slots_{};
+  uint8_t back_{0};
+  std::atomic<uint8_t> middle_{1};
+  uint8_t front_{2};
+};
+
+#endif
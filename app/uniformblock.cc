@@ -0,0 +1,187 @@
+
+#include "uniformblock.h"
+
+#include <sstream>
+
+#include "glstate.h"
+
+namespace {
+
+// What the program reports for one member of a block.
+struct ReflectedMember {
+  std::string name;
+  BlockMemberInfo info;
+};
+
+// Strips the block name, which instanced blocks put in front of their
+// members, and the [0] of arrays.
+std::string_view MemberName(std::string_view name) {
+  const size_t dot{name.rfind('.')};
+  if (dot != std::string_view::npos) {
+    name.remove_prefix(dot + 1);
+  }
+  if (name.ends_with("[0]")) {
+    name.remove_suffix(3);
+  }
+  return name;
+}
+
+// Reads the program's reflection snapshot.
+bool ReflectUniformBlock(const GLSLProgram& program, const char* block,
+                         size_t& data_size,
+                         std::vector<ReflectedMember>& members) {
+  const ProgramReflection& reflection{program.Reflection()};
+  const ReflectedBlock* found{reflection.FindBlock(block)};
+  if (found == nullptr) {
+    return false;
+  }
+  data_size = static_cast<size_t>(found->data_size);
+  const auto indices{
+      reflection.MemberIndices().subspan(found->first_member,
+                                         found->num_members)};
+  for (const uint32_t index : indices) {
+    const ReflectedUniform& uniform{reflection.Uniforms()[index]};
+    members.push_back(ReflectedMember{
+        std::string{reflection.Name(uniform.name)},
+        BlockMemberInfo{static_cast<size_t>(uniform.offset), uniform.type,
+                        static_cast<size_t>(uniform.size),
+                        static_cast<size_t>(uniform.array_stride),
+                        static_cast<size_t>(uniform.matrix_stride)}});
+  }
+  return true;
+}
+
+bool ReflectStorageBlock(GLuint program, const char* block,
+                         size_t& data_size,
+                         std::vector<ReflectedMember>& members) {
+#ifdef __APPLE__
+  // Shader storage blocks need OpenGL 4.3.
+  return false;
+#else
+  const GLuint index{
+      glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, block)};
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+  const std::array<GLenum, 2> block_properties{GL_BUFFER_DATA_SIZE,
+                                               GL_NUM_ACTIVE_VARIABLES};
+  std::array<GLint, 2> block_values{};
+  glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, index,
+                         block_properties.size(), block_properties.data(),
+                         block_values.size(), nullptr, block_values.data());
+  data_size = static_cast<size_t>(block_values[0]);
+  std::vector<GLint> variables(block_values[1]);
+  const GLenum active_variables{GL_ACTIVE_VARIABLES};
+  glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, index, 1,
+                         &active_variables, block_values[1], nullptr,
+                         variables.data());
+  const std::array<GLenum, 6> properties{
+      GL_OFFSET,       GL_TYPE,          GL_ARRAY_SIZE,
+      GL_ARRAY_STRIDE, GL_MATRIX_STRIDE, GL_NAME_LENGTH};
+  for (const GLint variable : variables) {
+    std::array<GLint, 6> values{};
+    glGetProgramResourceiv(program, GL_BUFFER_VARIABLE, variable,
+                           properties.size(), properties.data(),
+                           values.size(), nullptr, values.data());
+    std::string name(values[5], '\0');
+    GLsizei written{0};
+    glGetProgramResourceName(program, GL_BUFFER_VARIABLE, variable, values[5],
+                             &written, name.data());
+    name.resize(written);
+    members.push_back(ReflectedMember{
+        name, BlockMemberInfo{static_cast<size_t>(values[0]),
+                              static_cast<GLenum>(values[1]),
+                              static_cast<size_t>(values[2]),
+                              static_cast<size_t>(values[3]),
+                              static_cast<size_t>(values[4])}});
+  }
+  return true;
+#endif
+}
+
+size_t UniformBufferAlignment() {
+  GLint alignment{0};
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  return static_cast<size_t>(std::max(alignment, 1));
+}
+
+}  // namespace
+
+void ValidateBlockLayout(const GLSLProgram& program, const char* block,
+                         BlockPacking packing, size_t size,
+                         std::span<const BlockMemberInfo> members,
+                         std::span<const std::string_view> names) {
+  size_t data_size{0};
+  std::vector<ReflectedMember> reflected;
+  const bool found{
+      packing == BlockPacking::kStd140
+          ? ReflectUniformBlock(program, block, data_size, reflected)
+          : ReflectStorageBlock(program.Id(), block, data_size, reflected)};
+  std::stringstream errors;
+  if (not found) {
+    errors << "Program " << program.Id() << " has no active "
+           << (packing == BlockPacking::kStd140 ? "uniform" : "storage")
+           << " block " << block << ".\n";
+    throw UniformBlockException(errors.str());
+  }
+  // Drivers report either the end of the last member or the padded size.
+  if (data_size > size) {
+    errors << "  the block is " << data_size << " bytes, the layout " << size
+           << ".\n";
+  }
+  for (const ReflectedMember& member : reflected) {
+    const std::string_view name{MemberName(member.name)};
+    const auto expected_name{std::find(names.begin(), names.end(), name)};
+    if (expected_name == names.end()) {
+      errors << "  " << member.name << " is not in the layout.\n";
+      continue;
+    }
+    const BlockMemberInfo& expected{
+        members[std::distance(names.begin(), expected_name)]};
+    const BlockMemberInfo& actual{member.info};
+    if (actual.type != expected.type) {
+      errors << "  " << member.name << " is a "
+             << GetTypeString(actual.type) << ", not a "
+             << GetTypeString(expected.type) << ".\n";
+    }
+    if (actual.offset != expected.offset) {
+      errors << "  " << member.name << " is at offset " << actual.offset
+             << ", not " << expected.offset << ".\n";
+    }
+    if (actual.array_size != expected.array_size or
+        actual.array_stride != expected.array_stride) {
+      errors << "  " << member.name << " has " << actual.array_size
+             << " elements " << actual.array_stride << " bytes apart, not "
+             << expected.array_size << " " << expected.array_stride
+             << " bytes apart.\n";
+    }
+    if (actual.matrix_stride != expected.matrix_stride) {
+      errors << "  " << member.name << " has columns "
+             << actual.matrix_stride << " bytes apart, not "
+             << expected.matrix_stride << ".\n";
+    }
+  }
+  if (not errors.str().empty()) {
+    throw UniformBlockException("Block " + std::string{block} +
+                                " does not match its layout:\n" +
+                                errors.str());
+  }
+}
+
+UniformRing::UniformRing(size_t bytes_per_frame,
+                         unsigned int frames_in_flight)
+    : stream_{GL_UNIFORM_BUFFER, bytes_per_frame, UniformBufferAlignment(),
+              frames_in_flight} {}
+
+void UniformRing::Bind(GLuint binding, const BlockRange& range) {
+  stream_.Flush();
+  GLStateCache::Current().BindBufferRange(GL_UNIFORM_BUFFER, binding,
+                                          stream_.Id(), range.offset,
+                                          range.size);
+}
+
+std::ostream& operator<<(std::ostream& out, const UniformRing& ring) {
+  out << "Uniform ring (" << (ring.IsPersistent() ? "persistent" : "copied")
+      << "): " << ring.Stats() << "\n";
+  return out;
+}
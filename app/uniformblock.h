@@ -0,0 +1,321 @@
+#ifndef UNIFORMBLOCK_H_
+#define UNIFORMBLOCK_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "glad/gl.h"
+#include "glslshader.h"
+#include "msutil.h"
+#include "streambuffer.h"
+
+class UniformBlockException : public std::runtime_error {
+ public:
+  explicit UniformBlockException(const std::string& message)
+      : std::runtime_error(message) {}
+};
+
+// The memory layouts GLSL defines for blocks. Uniform blocks use std140;
+// shader storage blocks may use std430, which does not round arrays and
+// matrix columns of scalars and vec2s up to 16 bytes.
+enum class BlockPacking { kStd140, kStd430 };
+
+// What reflection should report for one member of a block.
+struct BlockMemberInfo {
+  size_t offset;
+  GLenum type;
+  // 1 unless the member is an array.
+  size_t array_size;
+  // 0 unless the member is an array.
+  size_t array_stride;
+  // 0 unless the member is a matrix.
+  size_t matrix_stride;
+};
+
+namespace block_packing {
+
+// The GLSL type of a C++ block member: a scalar, a glm vector or a square
+// glm matrix of floats, ints or unsigned ints, or a std::array of those.
+template <typename T>
+struct Traits;
+
+template <typename S>
+struct ScalarTraits {
+  static constexpr bool kSupported{false};
+};
+
+template <>
+struct ScalarTraits<float> {
+  static constexpr bool kSupported{true};
+  static constexpr std::array<GLenum, 4> kTypes{GL_FLOAT, GL_FLOAT_VEC2,
+                                                GL_FLOAT_VEC3, GL_FLOAT_VEC4};
+};
+
+template <>
+struct ScalarTraits<int32_t> {
+  static constexpr bool kSupported{true};
+  static constexpr std::array<GLenum, 4> kTypes{GL_INT, GL_INT_VEC2,
+                                                GL_INT_VEC3, GL_INT_VEC4};
+};
+
+template <>
+struct ScalarTraits<uint32_t> {
+  static constexpr bool kSupported{true};
+  static constexpr std::array<GLenum, 4> kTypes{
+      GL_UNSIGNED_INT, GL_UNSIGNED_INT_VEC2, GL_UNSIGNED_INT_VEC3,
+      GL_UNSIGNED_INT_VEC4};
+};
+
+constexpr size_t kVec4Alignment{16};
+
+// A column of a matrix, an element of an array, or a whole member.
+template <typename S, int kLength>
+struct VectorTraits {
+  static_assert(ScalarTraits<S>::kSupported,
+                "Block members must be float, int32_t or uint32_t based.");
+  static constexpr size_t kSize{sizeof(S) * kLength};
+  // A vec3 is aligned like a vec4.
+  static constexpr size_t kAlignment{sizeof(S) * (kLength == 3 ? 4 : kLength)};
+  static constexpr GLenum kType{ScalarTraits<S>::kTypes[kLength - 1]};
+};
+
+template <>
+struct Traits<float> : VectorTraits<float, 1> {};
+
+template <>
+struct Traits<int32_t> : VectorTraits<int32_t, 1> {};
+
+template <>
+struct Traits<uint32_t> : VectorTraits<uint32_t, 1> {};
+
+template <int kLength, typename S, glm::qualifier Q>
+struct Traits<glm::vec<kLength, S, Q>> : VectorTraits<S, kLength> {};
+
+// The stride between the elements of an array of Element, which is also
+// the array's alignment.
+template <BlockPacking Packing, typename Column>
+constexpr size_t ElementStride() {
+  if constexpr (Packing == BlockPacking::kStd140) {
+    return ms_util::RoundUp(Column::kAlignment, kVec4Alignment);
+  } else {
+    return Column::kAlignment;
+  }
+}
+
+// Lays out one member of type T at offset and copies values into it.
+template <BlockPacking Packing, typename T>
+struct Member {
+  using Vector = Traits<T>;
+  static constexpr size_t kAlignment{Vector::kAlignment};
+  static constexpr size_t kSize{Vector::kSize};
+
+  static constexpr BlockMemberInfo Info(size_t offset) {
+    return BlockMemberInfo{offset, Vector::kType, 1, 0, 0};
+  }
+
+  static void Write(std::byte* at, const T& value) {
+    std::memcpy(at, &value, kSize);
+  }
+};
+
+template <BlockPacking Packing, int kSide, typename S, glm::qualifier Q>
+struct Member<Packing, glm::mat<kSide, kSide, S, Q>> {
+  static_assert(std::is_same_v<S, float>,
+                "Only float matrices are supported.");
+  using Column = VectorTraits<S, kSide>;
+  // Matrices are stored as arrays of columns.
+  static constexpr size_t kColumnStride{ElementStride<Packing, Column>()};
+  static constexpr size_t kAlignment{kColumnStride};
+  static constexpr size_t kSize{kColumnStride * kSide};
+  static constexpr std::array<GLenum, 3> kTypes{GL_FLOAT_MAT2, GL_FLOAT_MAT3,
+                                                GL_FLOAT_MAT4};
+
+  static constexpr BlockMemberInfo Info(size_t offset) {
+    return BlockMemberInfo{offset, kTypes[kSide - 2], 1, 0, kColumnStride};
+  }
+
+  static void Write(std::byte* at, const glm::mat<kSide, kSide, S, Q>& value) {
+    for (int column = 0; column < kSide; column++) {
+      std::memcpy(at + column * kColumnStride, &value[column], Column::kSize);
+    }
+  }
+};
+
+template <BlockPacking Packing, typename T, size_t kCount>
+struct Member<Packing, std::array<T, kCount>> {
+  using Element = Member<Packing, T>;
+  static constexpr size_t kStride{
+      Packing == BlockPacking::kStd140
+          ? ms_util::RoundUp(Element::kSize > Element::kAlignment
+                                 ? Element::kSize
+                                 : Element::kAlignment,
+                             kVec4Alignment)
+          : ms_util::RoundUp(Element::kSize, Element::kAlignment)};
+  static constexpr size_t kAlignment{
+      Packing == BlockPacking::kStd140
+          ? ms_util::RoundUp(Element::kAlignment, kVec4Alignment)
+          : Element::kAlignment};
+  static constexpr size_t kSize{kStride * kCount};
+
+  static constexpr BlockMemberInfo Info(size_t offset) {
+    BlockMemberInfo info{Element::Info(offset)};
+    info.array_size = kCount;
+    info.array_stride = kStride;
+    return info;
+  }
+
+  static void Write(std::byte* at, const std::array<T, kCount>& values) {
+    for (size_t i = 0; i < kCount; i++) {
+      Element::Write(at + i * kStride, values[i]);
+    }
+  }
+};
+
+}  // namespace block_packing
+
+// The layout of a block whose members have the types Members..., in
+// order, computed at compile time. For example, the block
+//
+//   uniform Frame {
+//     mat4 view;
+//     mat4 projection;
+//     vec3 eye;
+//     float time;
+//   };
+//
+// is described by
+//
+//   using FrameLayout = BlockLayout<BlockPacking::kStd140, glm::mat4,
+//                                   glm::mat4, glm::vec3, float>;
+//
+// and FrameLayout::Pack(bytes, view, projection, eye, time) writes it.
+// Nested structs are not supported.
+template <BlockPacking Packing, typename... Members>
+class BlockLayout {
+ public:
+  static constexpr size_t kNumMembers{sizeof...(Members)};
+
+  static constexpr std::array<BlockMemberInfo, kNumMembers> kMembers{[] {
+    std::array<BlockMemberInfo, kNumMembers> members{};
+    size_t end{0};
+    size_t i{0};
+    (
+        [&] {
+          using M = block_packing::Member<Packing, Members>;
+          const size_t offset{ms_util::RoundUp(end, M::kAlignment)};
+          members[i++] = M::Info(offset);
+          end = offset + M::kSize;
+        }(),
+        ...);
+    return members;
+  }()};
+
+  static constexpr size_t kAlignment{[] {
+    size_t alignment{Packing == BlockPacking::kStd140
+                         ? block_packing::kVec4Alignment
+                         : 4};
+    ((alignment = std::max(
+          alignment, block_packing::Member<Packing, Members>::kAlignment)),
+     ...);
+    return alignment;
+  }()};
+
+  // The size of the block, padded to its alignment.
+  static constexpr size_t kSize{[] {
+    size_t end{0};
+    ((end = ms_util::RoundUp(
+          end, block_packing::Member<Packing, Members>::kAlignment) +
+            block_packing::Member<Packing, Members>::kSize),
+     ...);
+    return ms_util::RoundUp(end, kAlignment);
+  }()};
+
+  static constexpr BlockPacking kPacking{Packing};
+
+  // Writes kSize bytes; padding is left as it was.
+  static void Pack(std::byte* out, const Members&... values) {
+    size_t i{0};
+    (block_packing::Member<Packing, Members>::Write(
+         out + kMembers[i++].offset, values),
+     ...);
+  }
+};
+
+// Throws a UniformBlockException unless the program's block has the
+// layout's offsets, types and strides. names are the members' names in
+// the shader, in order. A std140 layout is checked against a uniform
+// block and a std430 layout against a shader storage block; a member the
+// compiler removed as unused is skipped.
+void ValidateBlockLayout(const GLSLProgram& program, const char* block,
+                         BlockPacking packing, size_t size,
+                         std::span<const BlockMemberInfo> members,
+                         std::span<const std::string_view> names);
+
+template <typename Layout>
+void ValidateBlockLayout(
+    const GLSLProgram& program, const char* block,
+    const std::array<std::string_view, Layout::kNumMembers>& names) {
+  ValidateBlockLayout(program, block, Layout::kPacking, Layout::kSize,
+                      Layout::kMembers, names);
+}
+
+// Where a block was written in a UniformRing.
+using BlockRange = StreamRange;
+
+// Streams uniform blocks to the GPU through a StreamBuffer. A frame writes
+// blocks one after another into its region and binds each with
+// glBindBufferRange, so many glUniform calls become one copy and one
+// bind.
+class UniformRing {
+ public:
+  static constexpr unsigned int kDefaultFramesInFlight{
+      StreamBuffer::kDefaultFramesInFlight};
+
+  // Needs a current context.
+  explicit UniformRing(size_t bytes_per_frame,
+                       unsigned int frames_in_flight = kDefaultFramesInFlight);
+
+  // Call before writing the frame's first block. Waits if the GPU is still
+  // reading this frame's region from frames_in_flight frames ago.
+  void BeginFrame() { stream_.BeginFrame(); }
+
+  // Reserves size bytes, aligned for glBindBufferRange. Throws a
+  // StreamBufferException when the frame's region is full.
+  BlockRange Allocate(size_t size) { return stream_.Allocate(size); }
+
+  template <typename Layout, typename... Values>
+  BlockRange Push(const Values&... values) {
+    const BlockRange range{Allocate(Layout::kSize)};
+    Layout::Pack(range.data, values...);
+    return range;
+  }
+
+  // Binds range to the uniform buffer binding point.
+  void Bind(GLuint binding, const BlockRange& range);
+
+  // Call after the frame's last draw that reads the ring.
+  void EndFrame() { stream_.EndFrame(); }
+
+  bool IsPersistent() const { return stream_.IsPersistent(); }
+
+  // Allocations are blocks.
+  const StreamBufferStats& Stats() const { return stream_.Stats(); }
+
+ private:
+  StreamBuffer stream_;
+};
+
+std::ostream& operator<<(std::ostream& out, const UniformRing& ring);
+
+#endif
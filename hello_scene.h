@@ -2,12 +2,28 @@
 #ifndef HELLO_SCENE_H_
 #define HELLO_SCENE_H_
 
+#include <array>
+#include <cstddef>
 #include <glm/glm.hpp>
+#include <string>
+#include <vector>
 
+#include "commandbuffer.h"
 #include "glfwapp.h"
 #include "glslshader.h"
+#include "glstate.h"
+#include "mesh.h"
 #include "scene.h"
 
+struct TriangleVertex {
+  glm::vec3 position;
+  glm::u8vec4 color;
+};
+
+using TriangleLayout = VertexLayout<TriangleVertex, glm::vec3, glm::u8vec4>;
+static_assert(TriangleLayout::kAttributes[1].offset ==
+              offsetof(TriangleVertex, color));
+
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
 class HelloScene : public Scene {
  public:
@@ -17,15 +33,35 @@ class HelloScene : public Scene {
 
   ~HelloScene() override = default;
 
+  std::vector<std::string> Resources() const override {
+    return {kVertexShader, kFragmentShader};
+  }
+
+  bool Prepare() override {
+    // The triangle needs no names: its attributes have explicit locations
+    // and it has no uniforms.
+    LoadShaderProgram(program, kVertexShader, kFragmentShader, {},
+                      SpirvUse::kIfBuilt);
+    ms_util::GLErrorCheck();
+    program.PrintActiveAttribs();
+    program.PrintActiveUniforms();
+    ValidateVertexLayout<TriangleLayout>(program, {"position", "color"});
+    // Green
+    const glm::u8vec4 triangle_color{0, 255, 0, 255};
+    const std::array<TriangleVertex, 3> vertices{
+        TriangleVertex{{-0.5, -0.5, 0.5}, triangle_color},
+        TriangleVertex{{0.5, -0.5, 0.5}, triangle_color},
+        TriangleVertex{{0.0, 0.5, 0.5}, triangle_color}};
+    triangle.SetVertices(vertices);
+    return !ms_util::GLErrorCheck();
+  }
+
   bool Begin() override {
     if (not already_initialized) {
-      LoadShaderProgram(program, "shaders/triangle.vert.glsl",
-                        "shaders/triangle.frag.glsl");
-      ms_util::GLErrorCheck();
-      program.PrintActiveAttribs();
-      program.PrintActiveUniforms();
-      glGenVertexArrays(1, &vao_handle);
-      glBindVertexArray(vao_handle);
+      // Vertex arrays are not shared between contexts, so this cannot
+      // happen in Prepare.
+      triangle.Bind();
+      RecordDrawCommands();
       glClearColor(0.5, 0.5, 0.5, 1.0);
       already_initialized = true;
     }
@@ -33,27 +69,27 @@ class HelloScene : public Scene {
   }
 
   bool Draw(double time) override {
-    // Purple
-    glm::vec4 background_color{1.0, 0.0, 1.0, 1.0};
-
-    glClearBufferfv(GL_COLOR, 0, glm::value_ptr(background_color));
-
-    // Activate the shading program
-    program.Activate();
-
-    glm::vec4 triangle_color{0.0, 1.0, 0.0, 1.0};
-
-    // Send the values that were just calculated to the vertex shader.
-    glVertexAttrib4fv(0, glm::value_ptr(triangle_color));
+    // The frame never changes, so the recorded commands are replayed as
+    // they are unless a hot reload replaced the program they use.
+    if (program.Generation() != recorded_generation) {
+      RecordDrawCommands();
+    }
+    draw_commands.Execute();
+    return !ms_util::GLErrorCheck();
+  }
 
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+  // Update changes nothing that Draw reads, so the snapshot is only the
+  // time.
+  std::shared_ptr<const SceneSnapshot> Snapshot(double time) override {
+    return std::make_shared<const SceneSnapshot>(time, interpolation_alpha);
+  }
 
-    return !ms_util::GLErrorCheck();
+  bool DrawSnapshot(const SceneSnapshot& snapshot) override {
+    return Draw(snapshot.time);
   }
 
   bool End() override {
     GLSLProgram::Deactivate();
-    // glDeleteVertexArrays(1, &vao_handle_);
     return !ms_util::GLErrorCheck();
   }
 
@@ -66,20 +102,40 @@ class HelloScene : public Scene {
         app->InvalidateScene();
       }
     }
-    return !ms_util::GLErrorCheck();
+    // No GL calls here; with a render thread Update has no GL context.
+    return true;
   }
 
   bool Resize(size_t width, size_t height) override {
     this->width = width;
     this->height = height;
-    glViewport(0, 0, this->width, this->height);
+    GLStateCache::Current().Viewport(0, 0, this->width, this->height);
     return !ms_util::GLErrorCheck();
   }
 
  protected:
+  void RecordDrawCommands() {
+    draw_commands.Reset();
+    recorded_generation = program.Generation();
+
+    // Purple
+    const glm::vec4 background_color{1.0, 0.0, 1.0, 1.0};
+    draw_commands.ClearColor(background_color);
+
+    // Activate the shading program
+    draw_commands.UseProgram(program);
+
+    triangle.Record(draw_commands);
+  }
+
+  static constexpr const char* kVertexShader{"shaders/triangle.vert.glsl"};
+  static constexpr const char* kFragmentShader{"shaders/triangle.frag.glsl"};
+
   // NOLINTBEGIN(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
-  GLuint vao_handle{0};
+  Mesh<TriangleLayout> triangle;
   GLSLProgram program;
+  CommandBuffer draw_commands;
+  unsigned int recorded_generation{0};
   bool already_initialized{false};
   // NOLINTEND(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
 };
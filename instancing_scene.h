@@ -0,0 +1,281 @@
+
+#ifndef INSTANCING_SCENE_H_
+#define INSTANCING_SCENE_H_
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "culling.h"
+#include "drawbatcher.h"
+#include "glfwapp.h"
+#include "glslshader.h"
+#include "glstate.h"
+#include "mesh.h"
+#include "scene.h"
+#include "uniformblock.h"
+
+struct QuadVertex {
+  glm::vec2 position;
+};
+
+using QuadLayout = VertexLayout<QuadVertex, glm::vec2>;
+
+struct QuadInstance {
+  glm::mat4 model;
+  glm::u8vec4 color;
+};
+
+using QuadInstanceLayout = VertexLayout<QuadInstance, glm::mat4, glm::u8vec4>;
+
+// An element of the Draws block of multidraw.vert.glsl.
+using QuadDrawLayout =
+    BlockLayout<BlockPacking::kStd430, glm::mat4, glm::vec4>;
+
+enum class InstancingMode {
+  // One instanced draw call.
+  kInstanced,
+  // A draw call and two uniform writes per quad.
+  kPerDraw,
+  // A DrawBatcher draw per quad, submitted with one multi-draw call.
+  kMultiDraw,
+};
+
+// Draws a grid of small quads in one of the InstancingModes and prints the
+// mean frame time when it ends. Run it headless, for example with
+// --headless 10 --instancing 1000000, with and without --per-draw or
+// --multi-draw. A zoom above 1 magnifies the middle of the grid, so that
+// most quads are outside the window. With cull, the quads drawn one at a
+// time are culled against the view first and only the visible ones are
+// drawn or added to the DrawBatcher; the single instanced draw is not
+// culled.
+// NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
+class InstancingScene : public Scene {
+ public:
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+  InstancingScene(std::shared_ptr<GLFWApp> app, size_t num_instances,
+                  InstancingMode mode, float zoom = 1.0F, bool cull = false)
+      : Scene("Instancing", app, 600, 600),
+        num_instances{num_instances},
+        mode{mode},
+        zoom{zoom},
+        cull{cull} {};
+
+  ~InstancingScene() override = default;
+
+  std::vector<std::string> Resources() const override {
+    return {VertexShader(), kFragmentShader};
+  }
+
+  bool Prepare() override {
+    if (mode == InstancingMode::kMultiDraw) {
+      // Throws before the shader fails to compile if the context cannot
+      // multi-draw.
+      batcher = std::make_unique<DrawBatcher>(QuadDrawLayout::kSize,
+                                              num_instances);
+      LoadShaderProgram(program, VertexShader(), kFragmentShader);
+    } else {
+      LoadShaderProgram(program, VertexShader(), kFragmentShader,
+                        mode == InstancingMode::kPerDraw
+                            ? std::vector<std::string>{"PER_DRAW"}
+                            : std::vector<std::string>{});
+    }
+    const std::array<QuadVertex, 4> vertices{
+        QuadVertex{{-1.0, -1.0}}, QuadVertex{{1.0, -1.0}},
+        QuadVertex{{1.0, 1.0}}, QuadVertex{{-1.0, 1.0}}};
+    const std::array<uint16_t, 6> indices{0, 1, 2, 0, 2, 3};
+    quad.SetVertices(vertices);
+    quad.SetIndices<uint16_t>(indices);
+
+    // A square grid over the window, each quad filling most of its cell.
+    const auto side{static_cast<size_t>(
+        std::ceil(std::sqrt(static_cast<double>(num_instances))))};
+    const float cell{2.0F / static_cast<float>(side)};
+    const glm::mat4 view{glm::scale(glm::mat4{1.0F}, glm::vec3{zoom})};
+    if (cull and mode != InstancingMode::kInstanced) {
+      culler = std::make_unique<FrustumCuller>();
+      frustum = Frustum::FromMatrix(view);
+    }
+    instances.resize(num_instances);
+    for (size_t i = 0; i < num_instances; i++) {
+      const glm::vec2 center{-1.0F + cell * (static_cast<float>(i % side) +
+                                             0.5F),
+                             -1.0F + cell * (static_cast<float>(i / side) +
+                                             0.5F)};
+      instances[i].model =
+          view * glm::scale(glm::translate(glm::mat4{1.0F},
+                                           glm::vec3{center, 0.0F}),
+                            glm::vec3{cell * 0.4F});
+      if (culler) {
+        // Around the quad's corners.
+        bounds.Add(glm::vec3{center, 0.0F}, cell * 0.4F * std::sqrt(2.0F));
+      }
+      instances[i].color = glm::u8vec4{(i % side) * 255 / side,
+                                       (i / side) * 255 / side, 128, 255};
+    }
+
+    if (mode == InstancingMode::kPerDraw) {
+      ValidateVertexLayout<QuadLayout>(program, {"position"});
+      model = program.GetUniform<glm::mat4>("model");
+      color = program.GetUniform<glm::vec4>("instance_color");
+    } else if (mode == InstancingMode::kMultiDraw) {
+      ValidateVertexLayout<QuadLayout>(program, {"position"});
+      ValidateBlockLayout<QuadDrawLayout>(program, "Draws",
+                                          {"model", "color"});
+    } else {
+      ValidateVertexLayout<QuadLayout, QuadInstanceLayout>(
+          program, {"position"}, {"model", "instance_color"});
+      instance_buffer.Upload(instances);
+      quad.SetInstances(instance_buffer);
+      // The GPU has its own copy.
+      instances = std::vector<QuadInstance>{};
+    }
+    return !ms_util::GLErrorCheck();
+  }
+
+  bool Begin() override {
+    // Vertex arrays are not shared between contexts, so this cannot happen
+    // in Prepare.
+    quad.Bind();
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    frames = 0;
+    return !ms_util::GLErrorCheck();
+  }
+
+  bool Draw(double time) override {
+    if (frames == 0) {
+      start = std::chrono::steady_clock::now();
+    }
+    frames++;
+    glClear(GL_COLOR_BUFFER_BIT);
+    program.Activate();
+    constexpr float kColorScale{1.0F / 255.0F};
+    if (culler) {
+      culler->Cull(frustum, bounds, visible);
+    }
+    // Every quad, or the visible ones when culling.
+    const auto for_each_drawn{[this](const auto& draw) {
+      if (culler) {
+        for (const uint32_t index : visible) {
+          draw(instances[index]);
+        }
+      } else {
+        for (const QuadInstance& instance : instances) {
+          draw(instance);
+        }
+      }
+    }};
+    if (mode == InstancingMode::kPerDraw) {
+      for_each_drawn([&](const QuadInstance& instance) {
+        model.Set(instance.model);
+        color.Set(glm::vec4{instance.color} * kColorScale);
+        quad.Draw();
+      });
+    } else if (mode == InstancingMode::kMultiDraw) {
+      batcher->BeginFrame();
+      for_each_drawn([&](const QuadInstance& instance) {
+        batcher->Add<QuadDrawLayout>(program.Id(), quad, instance.model,
+                                     glm::vec4{instance.color} * kColorScale);
+      });
+      batcher->Submit();
+      batcher->EndFrame();
+    } else {
+      quad.DrawInstanced(static_cast<GLsizei>(num_instances));
+    }
+    return !ms_util::GLErrorCheck();
+  }
+
+  // The instances are fixed after Prepare and Update changes nothing that
+  // Draw reads, so the snapshot is only the time.
+  std::shared_ptr<const SceneSnapshot> Snapshot(double time) override {
+    return std::make_shared<const SceneSnapshot>(time, interpolation_alpha);
+  }
+
+  bool DrawSnapshot(const SceneSnapshot& snapshot) override {
+    return Draw(snapshot.time);
+  }
+
+  bool End() override {
+    // Waits for the last frame so that it is counted.
+    glFinish();
+    const double elapsed_ms{std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count()};
+    // The quads drawn per frame, on average when culling.
+    unsigned long drawn{num_instances};
+    if (culler and culler->Stats().calls > 0) {
+      drawn = culler->Stats().visible / culler->Stats().calls;
+    }
+    constexpr std::array<const char*, 3> kModeNames{
+        "drawn instanced", "drawn one at a time", "drawn with multi-draw"};
+    std::cout << "Instancing benchmark: " << num_instances << " instances "
+              << kModeNames[static_cast<size_t>(mode)] << ", " << frames
+              << " frames, " << std::fixed << std::setprecision(3)
+              << (frames > 0 ? elapsed_ms / static_cast<double>(frames) : 0.0)
+              << " ms per frame, "
+              << (mode == InstancingMode::kPerDraw ? drawn : 1)
+              << " draw calls per frame\n"
+              << std::defaultfloat;
+    if (culler) {
+      std::cout << "Frustum culler: " << culler->Stats() << "\n";
+    }
+    if (batcher) {
+      std::cout << "Draw batcher: " << batcher->Stats() << "\n";
+    }
+    GLSLProgram::Deactivate();
+    return !ms_util::GLErrorCheck();
+  }
+
+  bool Update(double time) override {
+    while (not app->keyboard->IsEmpty()) {
+      app->keyboard->PopFront();
+    }
+    return true;
+  }
+
+  bool Resize(size_t width, size_t height) override {
+    this->width = width;
+    this->height = height;
+    GLStateCache::Current().Viewport(0, 0, this->width, this->height);
+    return !ms_util::GLErrorCheck();
+  }
+
+ protected:
+  static constexpr const char* kFragmentShader{"shaders/triangle.frag.glsl"};
+
+  const char* VertexShader() const {
+    return mode == InstancingMode::kMultiDraw ? "shaders/multidraw.vert.glsl"
+                                              : "shaders/instanced.vert.glsl";
+  }
+
+  // NOLINTBEGIN(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
+  size_t num_instances;
+  InstancingMode mode;
+  float zoom;
+  bool cull;
+  GLSLProgram program;
+  InstanceBuffer<QuadInstanceLayout> instance_buffer;
+  Mesh<QuadLayout> quad;
+  // Only kept when each quad is a draw.
+  std::vector<QuadInstance> instances;
+  std::unique_ptr<DrawBatcher> batcher;
+  // Made only when culling.
+  std::unique_ptr<FrustumCuller> culler;
+  Frustum frustum{};
+  BoundingSpheres bounds;
+  std::vector<uint32_t> visible;
+  Uniform<glm::mat4> model;
+  Uniform<glm::vec4> color;
+  unsigned long frames{0};
+  std::chrono::steady_clock::time_point start;
+  // NOLINTEND(cppcoreguidelines-non-private-member-variables-in-classes,misc-non-private-member-variables-in-classes)
+};
+
+#endif
@@ -1,14 +1,44 @@
 
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <string>
 
 #include "glad/gl.h"
 #include "glfwapp.h"
 #include "hello_scene.h"
+#include "instancing_scene.h"
+#include "programcache.h"
+#include "shaderlibrary.h"
 
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
 std::shared_ptr<GLFWApp> g_app;
 
+// Parses text as a whole decimal number that fits in value.
+template <typename T>
+bool ParseUnsigned(const char* text, T& value) {
+  char* end{nullptr};
+  errno = 0;
+  const unsigned long long parsed{std::strtoull(text, &end, 10)};
+  if (std::isdigit(static_cast<unsigned char>(*text)) == 0 or *end != '\0' or
+      errno == ERANGE or parsed > std::numeric_limits<T>::max()) {
+    return false;
+  }
+  value = static_cast<T>(parsed);
+  return true;
+}
+
+// Parses text as a whole floating point number.
+bool ParseFloat(const char* text, float& value) {
+  char* end{nullptr};
+  errno = 0;
+  value = std::strtof(text, &end);
+  return end != text and *end == '\0' and errno != ERANGE;
+}
+
 void GLFWBasicKeyCallback(GLFWwindow* window, int key, int scancode, int action,
                           int mods) {
   if (action == GLFW_PRESS) {
@@ -20,6 +50,9 @@ void GLFWBasicKeyCallback(GLFWwindow* window, int key, int scancode, int action,
       case GLFW_KEY_SPACE:
         g_app->ToggleAnimation();
         break;
+      case GLFW_KEY_F12:
+        g_app->DumpFrameTimings();
+        break;
       default:
         g_app->keyboard->PushBack(key, scancode, action, mods);
         break;
@@ -68,8 +101,82 @@ void GLFWBasicCursorPositionCallback(GLFWwindow* window, double mouse_x,
 }
 
 int main(int argc, char const* argv[]) {
+  HeadlessOptions headless;
+  PacingPolicy pacing{PacingPolicy::kSleep};
+  FixedTimestep fixed_step;
+  bool profile{false};
+  ThreadingModel threading{ThreadingModel::kSingleThread};
+  ms_util::GLCheckLevel check_level{ms_util::GetGLCheckLevel()};
+  size_t num_instances{0};
+  InstancingMode instancing_mode{InstancingMode::kInstanced};
+  float zoom{1.0F};
+  bool cull{false};
+  bool args_ok{true};
+  for (int i = 1; i < argc and args_ok; i++) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const std::string arg{argv[i]};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const char* value{i + 1 < argc ? argv[i + 1] : nullptr};
+    if (arg == "--headless") {
+      headless.enabled = true;
+      if (value != nullptr and
+          std::isdigit(static_cast<unsigned char>(*value)) != 0) {
+        args_ok = ParseUnsigned(value, headless.num_frames);
+        i++;
+      }
+    } else if (arg == "--pacing" and value != nullptr) {
+      args_ok = StringToPacingPolicy(value, pacing);
+      i++;
+    } else if (arg == "--tick-rate" and value != nullptr) {
+      args_ok = ParseUnsigned(value, fixed_step.tick_rate);
+      i++;
+    } else if (arg == "--profile") {
+      profile = true;
+    } else if (arg == "--render-thread") {
+      threading = ThreadingModel::kRenderThread;
+    } else if (arg == "--hot-reload") {
+      ShaderReloader::Instance().Enable();
+    } else if (arg == "--instancing" and value != nullptr) {
+      args_ok = ParseUnsigned(value, num_instances) and num_instances > 0;
+      i++;
+    } else if (arg == "--per-draw") {
+      instancing_mode = InstancingMode::kPerDraw;
+    } else if (arg == "--multi-draw") {
+      instancing_mode = InstancingMode::kMultiDraw;
+    } else if (arg == "--zoom" and value != nullptr) {
+      args_ok = ParseFloat(value, zoom) and zoom > 0.0F;
+      i++;
+    } else if (arg == "--cull") {
+      cull = true;
+    } else if (arg == "--no-spirv") {
+      ShaderLibrary::Instance().SetSpirvEnabled(false);
+    } else if (arg == "--shader-cache" and value != nullptr) {
+      ProgramBinaryCache::Instance().SetDirectory(
+          std::string{value} == "off" ? "" : value);
+      i++;
+    } else if (arg == "--gl-check" and value != nullptr) {
+      args_ok = ms_util::StringToGLCheckLevel(value, check_level);
+      i++;
+    } else {
+      args_ok = false;
+    }
+  }
+  if (not args_ok) {
+    std::cout << "Usage: " << argv[0]
+              << " [--headless num_frames] [--pacing vsync|sleep|wait]"
+                 " [--tick-rate ticks_per_second] [--profile]"
+                 " [--render-thread] [--gl-check off|debug|frame|call]"
+                 " [--shader-cache directory|off] [--hot-reload]"
+                 " [--no-spirv] [--instancing num_instances"
+                 " [--per-draw|--multi-draw] [--zoom factor] [--cull]]\n";
+    return 1;
+  }
+  ms_util::SetGLCheckLevel(check_level);
+
   try {
-    g_app = std::make_shared<GLFWApp>();
+    g_app = std::make_shared<GLFWApp>("GLFW Demo", kDefaultWindowWidth,
+                                      kDefaultWindowHeight, 60, true,
+                                      ms_util::GLFWErrorCallback, headless);
   } catch (const GLFWAppException& exception) {
     std::cout << "Error: " << exception.what() << "\n";
     return 1;
@@ -78,10 +185,19 @@ int main(int argc, char const* argv[]) {
     return 1;
   }
 
+  g_app->SetPacingPolicy(pacing);
+  g_app->SetFixedTimestep(fixed_step);
+  g_app->SetProfiling(profile);
+  g_app->SetThreadingModel(threading);
   g_app->SetKeyCallback(GLFWBasicKeyCallback);
   g_app->SetCursorPosCallback(GLFWBasicCursorPositionCallback);
   g_app->SetMouseButtonCallback(GLFWBasicMouseButtonCallback);
 
+  if (num_instances > 0) {
+    return g_app->Run(make_shared<InstancingScene>(
+        g_app, num_instances, instancing_mode, zoom, cull));
+  }
+
   auto hello_scene{make_shared<HelloScene>(g_app)};
 
   return g_app->Run(hello_scene);
@@ -0,0 +1,19 @@
+#version 410 core
+
+layout (location = 0) in vec2 position;
+
+#ifdef PER_DRAW
+uniform mat4 model;
+uniform vec4 instance_color;
+#else
+layout (location = 1) in mat4 model;
+layout (location = 5) in vec4 instance_color;
+#endif
+
+layout (location = 0) out vec4 vs_color;
+
+void main(void)
+{
+    gl_Position = model * vec4(position, 0.0, 1.0);
+    vs_color = instance_color;
+}
@@ -0,0 +1,23 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout (location = 0) in vec2 position;
+
+struct Draw {
+    mat4 model;
+    vec4 color;
+};
+
+// One element per draw added to a DrawBatcher since its last Submit, in
+// the order they were added. Each draw's base instance is its index.
+layout (std430, binding = 0) readonly buffer Draws {
+    Draw draws[];
+};
+
+layout (location = 0) out vec4 vs_color;
+
+void main(void)
+{
+    gl_Position = draws[gl_BaseInstanceARB].model * vec4(position, 0.0, 1.0);
+    vs_color = draws[gl_BaseInstanceARB].color;
+}
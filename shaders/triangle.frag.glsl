@@ -1,8 +1,8 @@
 #version 410 core
 
-in vec4 vs_color;
+layout (location = 0) in vec4 vs_color;
 
-out vec4 color;
+layout (location = 0) out vec4 color;
 
 void main(void)
 {
@@ -1,17 +1,12 @@
 #version 410 core
 
-layout (location = 0) in vec4 triangle_color;
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 color;
 
-out vec4 vs_color;
+layout (location = 0) out vec4 vs_color;
 
 void main(void)
 {
-    const vec4 vertices[3] = vec4[3](
-                                     vec4( -0.5, -0.5, 0.5, 1.0),
-                                     vec4(  0.5, -0.5, 0.5, 1.0),
-                                     vec4(  0.0,  0.5, 0.5, 1.0)
-                                    );
-
-    gl_Position = vertices[gl_VertexID];
-    vs_color = triangle_color;
-}
\ No newline at end of file
+    gl_Position = vec4(position, 1.0);
+    vs_color = color;
+}